@@ -0,0 +1,89 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include <stddef.h>
+
+#include <client/chess.h>
+#include <client/batch.h>
+
+void validate_moves(const struct game *game, const struct move *moves, int n,
+		int *results) {
+	struct move_list list;
+
+	generate_legal_moves(game, &list);
+	for (int i = 0; i < n; ++i) {
+		int code = find_legal_move(&list, &moves[i]);
+		results[i] = code < 0 ? code : 0;
+	}
+}
+
+int perft_positions(const char *const *fens, int n, int depth, long long *results) {
+	struct game *game;
+
+	if ((game = new_game()) == NULL) {
+		return -1;
+	}
+	for (int i = 0; i < n; ++i) {
+		if (init_game(game, fens[i])) {
+			results[i] = -1;
+			continue;
+		}
+		results[i] = count_positions(game, depth);
+	}
+	free_game(game);
+	return 0;
+}
+
+int game_statuses(const char *const *fens, int n, int *results) {
+	struct game *game;
+
+	if ((game = new_game()) == NULL) {
+		return -1;
+	}
+	for (int i = 0; i < n; ++i) {
+		if (init_game(game, fens[i])) {
+			results[i] = ILLEGAL_MOVE;
+			continue;
+		}
+		results[i] = game_status(game);
+	}
+	free_game(game);
+	return 0;
+}
+
+unsigned long long count_positions(struct game *game, int depth) {
+	struct move_list list;
+	unsigned long long ret = 0;
+
+	if (depth <= 0) {
+		return 1;
+	}
+	/* the moves at the last ply are leaves, there's no need to make them just
+	 * to count them. promotions are already four separate moves, and a
+	 * position with no moves has no leaves. */
+	generate_legal_moves(game, &list);
+	if (depth == 1) {
+		return list.len;
+	}
+	for (int i = 0; i < list.len; ++i) {
+		struct undo undo;
+		do_move(game, &list.moves[i], &undo);
+		ret += count_positions(game, depth - 1);
+		undo_move(game, &undo);
+	}
+	return ret;
+}
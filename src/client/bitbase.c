@@ -0,0 +1,83 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include <stdint.h>
+
+#include <client/chess.h>
+#include <client/bitbase.h>
+#include <client/bitboard.h>
+#include <client/bitbases.h>
+
+/* returns the one piece that `player` has next to its king, EMPTY if it only
+ * has the king, or KING if it has more than one piece */
+static enum piece_type lone_piece(const struct board *board, enum player player);
+
+int probe_bitbase(const struct game *game, enum player *strong) {
+	const struct board *board = &game->board;
+	enum piece_type white = lone_piece(board, WHITE);
+	enum piece_type black = lone_piece(board, BLACK);
+	enum piece_type type;
+	int strong_king, piece, weak_king, strong_to_move;
+	/* the tables are from white's side of the board */
+	int flip;
+
+	if (game->castling != 0) {
+		return -1;
+	}
+	if (white != EMPTY && black == EMPTY) {
+		*strong = WHITE;
+		type = white;
+	}
+	else if (black != EMPTY && white == EMPTY) {
+		*strong = BLACK;
+		type = black;
+	}
+	else {
+		return -1;
+	}
+	/* that also takes care of KING */
+	if (type != PAWN && type != ROOK && type != QUEEN) {
+		return -1;
+	}
+
+	flip = *strong == WHITE ? 0 : 56;
+	strong_king = board->king[*strong] ^ flip;
+	weak_king = board->king[*strong == WHITE ? BLACK : WHITE] ^ flip;
+	piece = lsb(board->pieces[*strong][type]) ^ flip;
+	strong_to_move = get_player(game) == *strong;
+
+	switch (type) {
+	case PAWN:
+		return kpk_table[kpk_index(strong_to_move, strong_king, piece, weak_king)];
+	case QUEEN:
+		return kqk_table[kxk_index(strong_to_move, strong_king, piece, weak_king)];
+	default:
+		return krk_table[kxk_index(strong_to_move, strong_king, piece, weak_king)];
+	}
+}
+
+static enum piece_type lone_piece(const struct board *board, enum player player) {
+	uint64_t pieces = board->occupied[player] & ~board->pieces[player][KING];
+
+	if (pieces == 0) {
+		return EMPTY;
+	}
+	if (pieces & (pieces - 1)) {
+		return KING;
+	}
+	return PIECE_TYPE(board->squares[lsb(pieces)]);
+}
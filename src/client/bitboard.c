@@ -0,0 +1,297 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* the generated tables get defined here */
+#define CLIENT_TABLES_DEFINE
+#include <client/bitboard.h>
+
+/* These were found with a brute force search over sparse random numbers. Every
+ * magic maps the relevant occupancy bits of its square onto popcount(mask)
+ * bits, so each square's slice of the table is the same size whether it's
+ * indexed with `pext` or with a multiplication. The two put the entries in a
+ * different order though, so the tables only work with the method they were
+ * filled in with. Filling and looking up both go through `magic_index`, which
+ * uses whatever `init_bitboards` picked. */
+static const uint64_t rook_magic_numbers[64] = {
+	UINT64_C(0x1080004008801020), UINT64_C(0x0840092002c03000),
+	UINT64_C(0x1900200010400900), UINT64_C(0x0880100008000480),
+	UINT64_C(0x4200100420080200), UINT64_C(0x8100020100080400),
+	UINT64_C(0x0200040110886200), UINT64_C(0x0200008040220411),
+	UINT64_C(0x0404800084400220), UINT64_C(0x0000401000402000),
+	UINT64_C(0x0086001081220440), UINT64_C(0x0408800800100280),
+	UINT64_C(0x000a001201040820), UINT64_C(0x8848800200840080),
+	UINT64_C(0x4001000100040200), UINT64_C(0x0442000102105084),
+	UINT64_C(0x9080010020804100), UINT64_C(0x0040404000201009),
+	UINT64_C(0x0000808010002009), UINT64_C(0x2200090021d00100),
+	UINT64_C(0x0008008008040080), UINT64_C(0x0004004002010040),
+	UINT64_C(0x0011040008015042), UINT64_C(0x00000a0001768104),
+	UINT64_C(0x0000800080204009), UINT64_C(0x2010004140002001),
+	UINT64_C(0x9800200280100080), UINT64_C(0x1000100080080080),
+	UINT64_C(0x0442000a00049020), UINT64_C(0x2100040080020080),
+	UINT64_C(0x0800120400900148), UINT64_C(0x0010040a00128541),
+	UINT64_C(0x2800804000800030), UINT64_C(0x1010002000400041),
+	UINT64_C(0x4000200011004100), UINT64_C(0x0610008410800800),
+	UINT64_C(0x0400802402800800), UINT64_C(0xc100020080800400),
+	UINT64_C(0x0002000802000401), UINT64_C(0x0182085882000401),
+	UINT64_C(0x0220204000808000), UINT64_C(0x2860100040024022),
+	UINT64_C(0x0001002004110040), UINT64_C(0x99101042000a0020),
+	UINT64_C(0x0004080004008080), UINT64_C(0x0010040002008080),
+	UINT64_C(0x2012004881020004), UINT64_C(0x8300842444820011),
+	UINT64_C(0x0088403882010200), UINT64_C(0x0820400080210100),
+	UINT64_C(0x0110910040a00300), UINT64_C(0x0801100280080480),
+	UINT64_C(0x0242009008200600), UINT64_C(0x1002000489500200),
+	UINT64_C(0x0040800200010080), UINT64_C(0x0091800041000080),
+	UINT64_C(0x0000209300488001), UINT64_C(0x04c1002414824001),
+	UINT64_C(0x020020000b001041), UINT64_C(0x7000100004200901),
+	UINT64_C(0x8002002004100802), UINT64_C(0x30010002084c0007),
+	UINT64_C(0x0888221800813004), UINT64_C(0x4000002840840112),
+};
+
+static const uint64_t bishop_magic_numbers[64] = {
+	UINT64_C(0xa010041108003100), UINT64_C(0x006082020a002900),
+	UINT64_C(0x6810010619200000), UINT64_C(0x08281a0520000408),
+	UINT64_C(0x0001104001000400), UINT64_C(0x0018901008048400),
+	UINT64_C(0x00040a0210245280), UINT64_C(0x000200210808a402),
+	UINT64_C(0x9140048410821200), UINT64_C(0x0800091010820041),
+	UINT64_C(0x20504804832202c0), UINT64_C(0x0100091401081000),
+	UINT64_C(0x8021011140000012), UINT64_C(0x0810020804450400),
+	UINT64_C(0x208b0542109008a2), UINT64_C(0x0080084a08040204),
+	UINT64_C(0x0040e2a80811244c), UINT64_C(0x2505022008008108),
+	UINT64_C(0x0430220100420040), UINT64_C(0x010a040420220040),
+	UINT64_C(0x1105000290400000), UINT64_C(0x0093001200822120),
+	UINT64_C(0x4000a62048043004), UINT64_C(0x280120048a015004),
+	UINT64_C(0x006090002a020814), UINT64_C(0x44042000240800d0),
+	UINT64_C(0x01102800040a4400), UINT64_C(0x1004080080220040),
+	UINT64_C(0x0001001011004024), UINT64_C(0x0010044000805040),
+	UINT64_C(0x0914041200820100), UINT64_C(0x0004821012821480),
+	UINT64_C(0x0024040500c05021), UINT64_C(0x0088611002080200),
+	UINT64_C(0x0116080a00040020), UINT64_C(0x4000020080080080),
+	UINT64_C(0x2450450140840040), UINT64_C(0x0000880201484100),
+	UINT64_C(0x0222020404020092), UINT64_C(0x8081110600002e00),
+	UINT64_C(0x2842101105000801), UINT64_C(0x1100809008001025),
+	UINT64_C(0x00020202221c0400), UINT64_C(0x0422014022009020),
+	UINT64_C(0x0210046102100c00), UINT64_C(0xc004008082029102),
+	UINT64_C(0x00aa461801101200), UINT64_C(0x0404080080201108),
+	UINT64_C(0x020542108c205002), UINT64_C(0x0410544804100100),
+	UINT64_C(0x0040910841100000), UINT64_C(0x0400200042021100),
+	UINT64_C(0x00004204850400c0), UINT64_C(0x0200100410a42102),
+	UINT64_C(0x1040020801210102), UINT64_C(0x0805040410420000),
+	UINT64_C(0x2884804130100200), UINT64_C(0x800c262201242000),
+	UINT64_C(0x1058000194108800), UINT64_C(0x0014221054420204),
+	UINT64_C(0x0104000012a02200), UINT64_C(0x0200881003300100),
+	UINT64_C(0x0140400202840100), UINT64_C(0x0402020801010201),
+};
+
+struct magic rook_magics[64];
+struct magic bishop_magics[64];
+bool have_pext;
+
+static uint64_t rook_table[0x19000];
+static uint64_t bishop_table[0x1480];
+
+/* walks from `sq` in the direction (dr, dc), stopping at the first occupied
+ * square. this is only used to fill in the tables. */
+static uint64_t ray_attacks(int sq, int dr, int dc, uint64_t occupied);
+
+/* the squares on the rays from `sq` that can actually block a slider. the last
+ * square of each ray doesn't matter, the slider attacks it either way. */
+static uint64_t relevant_mask(int sq, const int directions[4][2]);
+
+/* fills in `magics` and `table` for a slider that moves in `directions` */
+static void init_slider(struct magic magics[64], const uint64_t magic_numbers[64],
+		uint64_t *table, const int directions[4][2]);
+
+/* setting CHESSH_NO_PEXT in the environment makes this false, so that the
+ * multiplication can be tested on cpus that have `pext` */
+static bool cpu_has_fast_pext(void);
+
+/* implementations of `slider_fill`. the avx2 version puts four directions in
+ * each vector, the shifts towards h1 in one and the shifts towards a8 in the
+ * other. every direction shifts by a different amount, and without avx2's
+ * variable shifts the vector version is slower than the scalar one. */
+static uint64_t slider_fill_scalar(uint64_t rooks, uint64_t bishops, uint64_t empty);
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("avx2")))
+static uint64_t slider_fill_avx2(uint64_t rooks, uint64_t bishops, uint64_t empty);
+#endif
+
+uint64_t (*slider_fill)(uint64_t rooks, uint64_t bishops, uint64_t empty) =
+	slider_fill_scalar;
+
+static const int rook_directions[4][2] = { {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+static const int bishop_directions[4][2] = { {-1, -1}, {-1, 1}, {1, -1}, {1, 1} };
+
+void init_bitboards(void) {
+	static bool initialized = false;
+	if (initialized) {
+		return;
+	}
+	have_pext = cpu_has_fast_pext();
+#if defined(__x86_64__) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		slider_fill = slider_fill_avx2;
+	}
+#endif
+	init_slider(rook_magics, rook_magic_numbers, rook_table, rook_directions);
+	init_slider(bishop_magics, bishop_magic_numbers, bishop_table, bishop_directions);
+	initialized = true;
+}
+
+/* one direction of an occluded fill. `empty` has to already be masked so that
+ * nothing wraps around the edge of the board. */
+#define FILL(gen, empty, op, shift, mask) \
+	do { \
+		gen |= empty & (gen op (shift)); \
+		empty &= empty op (shift); \
+		gen |= empty & (gen op (shift)*2); \
+		empty &= empty op (shift)*2; \
+		gen |= empty & (gen op (shift)*4); \
+		gen = (gen op (shift)) & mask; \
+	} while (0)
+
+static uint64_t slider_fill_scalar(uint64_t rooks, uint64_t bishops, uint64_t empty) {
+	static const struct {
+		bool diagonal;
+		bool left;
+		int shift;
+		uint64_t mask;
+	} directions[8] = {
+		{ false, true, 1, ~FILE_A }, { true, true, 7, ~FILE_H },
+		{ false, true, 8, ~UINT64_C(0) }, { true, true, 9, ~FILE_A },
+		{ false, false, 1, ~FILE_H }, { true, false, 7, ~FILE_A },
+		{ false, false, 8, ~UINT64_C(0) }, { true, false, 9, ~FILE_H },
+	};
+	uint64_t ret = 0;
+
+	for (int i = 0; i < 8; ++i) {
+		uint64_t gen = directions[i].diagonal ? bishops : rooks;
+		uint64_t pro = empty & directions[i].mask;
+		if (directions[i].left) {
+			FILL(gen, pro, <<, directions[i].shift, directions[i].mask);
+		}
+		else {
+			FILL(gen, pro, >>, directions[i].shift, directions[i].mask);
+		}
+		ret |= gen;
+	}
+	return ret;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+typedef uint64_t u64x4 __attribute__((vector_size(32)));
+
+__attribute__((target("avx2")))
+static uint64_t slider_fill_avx2(uint64_t rooks, uint64_t bishops, uint64_t empty) {
+	const u64x4 shift = { 1, 7, 8, 9 };
+	const u64x4 left_mask = { ~FILE_A, ~FILE_H, ~UINT64_C(0), ~FILE_A };
+	const u64x4 right_mask = { ~FILE_H, ~FILE_A, ~UINT64_C(0), ~FILE_H };
+	u64x4 left = { rooks, bishops, rooks, bishops };
+	u64x4 right = left;
+	u64x4 left_empty = (u64x4) { empty, empty, empty, empty } & left_mask;
+	u64x4 right_empty = (u64x4) { empty, empty, empty, empty } & right_mask;
+
+	FILL(left, left_empty, <<, shift, left_mask);
+	FILL(right, right_empty, >>, shift, right_mask);
+
+	left |= right;
+	return left[0] | left[1] | left[2] | left[3];
+}
+#endif
+
+#undef FILL
+
+static uint64_t ray_attacks(int sq, int dr, int dc, uint64_t occupied) {
+	uint64_t ret = 0;
+	int r = ROW(sq) + dr;
+	int c = COL(sq) + dc;
+	while (0 <= r && r < 8 && 0 <= c && c < 8) {
+		ret |= BIT(SQUARE(r, c));
+		if (occupied & BIT(SQUARE(r, c))) {
+			break;
+		}
+		r += dr;
+		c += dc;
+	}
+	return ret;
+}
+
+static uint64_t relevant_mask(int sq, const int directions[4][2]) {
+	uint64_t ret = 0;
+	for (int i = 0; i < 4; ++i) {
+		int dr = directions[i][0];
+		int dc = directions[i][1];
+		int r = ROW(sq) + dr;
+		int c = COL(sq) + dc;
+		while (0 <= r + dr && r + dr < 8 && 0 <= c + dc && c + dc < 8) {
+			ret |= BIT(SQUARE(r, c));
+			r += dr;
+			c += dc;
+		}
+	}
+	return ret;
+}
+
+static void init_slider(struct magic magics[64], const uint64_t magic_numbers[64],
+		uint64_t *table, const int directions[4][2]) {
+	for (int sq = 0; sq < 64; ++sq) {
+		struct magic *magic = &magics[sq];
+		uint64_t occupied;
+
+		magic->mask = relevant_mask(sq, directions);
+		magic->magic = magic_numbers[sq];
+		magic->shift = 64 - popcount(magic->mask);
+		magic->attacks = table;
+
+		/* walk through every subset of the mask */
+		occupied = 0;
+		do {
+			uint64_t attacks = 0;
+			for (int i = 0; i < 4; ++i) {
+				attacks |= ray_attacks(sq, directions[i][0], directions[i][1], occupied);
+			}
+			magic->attacks[magic_index(magic, occupied)] = attacks;
+			occupied = (occupied - magic->mask) & magic->mask;
+		} while (occupied != 0);
+
+		table += BIT(popcount(magic->mask));
+	}
+}
+
+static bool cpu_has_fast_pext(void) {
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (getenv("CHESSH_NO_PEXT") != NULL) {
+		return false;
+	}
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("bmi2")) {
+		return false;
+	}
+	/* Zen 1 and Zen 2 implement pext in microcode, it's a lot slower than
+	 * just doing the multiplication */
+	if (__builtin_cpu_is("znver1") || __builtin_cpu_is("znver2")) {
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
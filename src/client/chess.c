@@ -19,132 +19,193 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
-
-#include <sys/param.h>
+#include <pthread.h>
 
 #include <util.h>
 #include <client/chess.h>
+#include <client/bitboard.h>
+#include <client/bitbase.h>
 
-/* precondition: game, move, captured, castle are all valid pointers
- * precondition: *captured == NULL
- * precondition: (*castle)->r_i == (*castle)->r_f ==
- *               (*castle)->c_i == * (*castle)->c_f == -1
- * returns: the corresponding `PIECE_is_illegal` function's return value
- * postcondition: *captured MAY be set to some extra casualty of this move, such
- *                as a pawn taken by en pessant (holy hell)
- * postcondition: *castle MAY be set to some move that also happens, probably
- *                due to castling.
- * XXX: This function does not account for checks */
-static int is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle, enum player player);
-
-/* precondition: game, move, captured, and castle are all valid pointers
- *               *captured == *castle = NULL
- * precondition: the moving piece and the destination are owned by different
- *               players
- * precondition: the moving piece is actually of the specified type
- * precondition: `move` doesn't start and end at the same spot
- * returns: <0 if a move made by this type of piece is illegal
- * postcondition: see `is_illegal` */
-static int rook_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle);
-static int knight_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle);
-static int bishop_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle);
-static int queen_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle);
-static int king_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle);
-static int pawn_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle);
-
-/* does `move`, completely unchecked. captures `captured`, possibly advances the
- * clock */
-static void move_unchecked(struct game *game, struct move *move, struct piece *captured, bool should_advance_clock);
-
-/* checks if game->board.board[r][c] is attacked by the person playing AGAINST
- * player. This means that if `player` is WHITE, then `piece_is_attacked` would
- * check if BLACK is attacking a certain tile.
- * XXX: this function breaks with en pessant */
-static bool piece_is_attacked(struct game *game, int r, int c, enum player player);
+/* checks the castling rules for `player`'s king on `from` moving two squares
+ * in the direction `cc`, `attacked` is every square the other player attacks.
+ * returns <0 if the castle is illegal. */
+static int castle_is_illegal(const struct game *game, enum player player, int from, int cc,
+		uint64_t attacked);
 
-/* checks if `player` is in check */
-static bool is_in_check(struct game *game, enum player player);
+/* adds/removes a piece from the mailbox and the bitboards */
+static inline void put_piece(struct board *board, int sq, unsigned char piece);
+static inline void remove_piece(struct board *board, int sq);
+
+/* rebuilds the bitboards from the mailbox */
+static void sync_bitboards(struct board *board);
+
+/* fills in the zobrist keys, calling this more than once is harmless */
+static void init_zobrist(void);
+
+/* sets up every global table the engine uses. `new_game` runs this exactly
+ * once, so games can be created from any number of threads. */
+static void init_engine(void);
 
-/* checks if `player` has a valid move to make */
-static bool can_make_move(struct game *game, enum player player);
+/* computes game->hash from scratch */
+static uint64_t compute_hash(const struct game *game);
 
-/* checks if the piece at [row][col] can make a move */
-static bool piece_can_move(struct game *game, int row, int col);
+/* the castling rights that are lost when a piece moves to or from `sq` */
+static inline int rights_lost(int sq);
+
+/* returns `pessant` if one of `player`'s pawns is in position to take en
+ * pessant on that square, -1 otherwise. This is what keeps positions where
+ * en pessant isn't actually possible from hashing differently. */
+static int usable_pessant(const struct game *game, enum player player, int pessant);
+
+/* returns the pieces of the person playing AGAINST `player` that attack square
+ * `sq` when the board's occupancy is `occupied` */
+static inline uint64_t attackers_to(const struct game *game, int sq, uint64_t occupied,
+		enum player player);
+
+/* checks if `player` is in check */
+static bool is_in_check(const struct game *game, enum player player);
+
+/* fills `list` with the legal moves that `player` can make and returns the
+ * number of moves found. pinned pieces and check evasions are worked out once
+ * up front, so every move that comes out of here is legal without having to
+ * be tried on the board. */
+static int generate_moves(const struct game *game, enum player player, struct move_list *list);
+
+/* the body of `generate_moves`. it's always inlined with a constant `player`,
+ * so every side-dependent branch and shift is resolved at compile time and
+ * `generate_white_moves` and `generate_black_moves` each get their own copy. */
+static inline int generate_moves_for(const struct game *game, struct move_list *list,
+		enum player player);
+static int generate_white_moves(const struct game *game, struct move_list *list);
+static int generate_black_moves(const struct game *game, struct move_list *list);
+
+/* appends the move from `from` to `to` to `list` */
+static inline void add_move(struct move_list *list, int from, int to, enum piece_type promotion);
+
+/* like `add_move`, but adds all four promotions if a pawn reaches the end of the
+ * board */
+static inline void add_pawn_move(struct move_list *list, int from, int to);
+
+struct legal_cache {
+	uint64_t hash; /* the position that `list` belongs to */
+	struct move_list list;
+};
+
+/* returns the legal moves of the current position, generating them only if
+ * they aren't already cached */
+static struct move_list *legal_moves(struct game *game);
+
+/* the 75 move rule ends the game before the history can get any longer */
+#define HISTORY_LEN 151
+
+struct history {
+	int len;
+	uint64_t hashes[HISTORY_LEN];
+};
+
+/* records the current position in the history and returns the number of times
+ * it has been seen, including this one. only positions since the last
+ * irreversible move are checked, nothing before that can repeat. */
+static int record_position(struct game *game);
+
+/* checks if neither player has enough material left to ever checkmate */
+static bool is_insufficient_material(const struct game *game);
 
 /* like make_move, but doesn't account for checkmate */
-static int make_move_no_checkmate(struct game *game, struct move *move);
+static int make_move_no_checkmate(struct game *game, const struct move *move);
 
-/* like is_illegal, but accounts for checks*/
-static inline int make_move_dryrun(struct game *game, struct move *move) {
-	struct game scratch;
-	memcpy(&scratch, game, sizeof scratch);
-	return make_move_no_checkmate(&scratch, move);
-}
+/* the body of `parse_fen`, this leaves `*s` wherever it stopped reading */
+static int read_fen(struct game *game, const char **s);
 
-/* returns -1 on error */
-static int parse_int(char *s, int start, int *end);
+/* These read one field of a FEN string starting at `*s` and move `*s` past
+ * it. They return -1 if the field isn't valid. */
+static int read_placement(struct board *board, const char **s);
+static int read_castling(struct game *game, const char **s);
+static int read_pessant(struct game *game, const char **s);
+static int read_clocks(struct game *game, const char **s);
+static int read_int(const char **s);
 
-#define PARSE_MOVE(game, move, src, dst) \
-	do { \
-		src = &game->board.board[move->r_i][move->c_i]; \
-		dst = &game->board.board[move->r_f][move->c_f]; \
-	} while (0)
+/* moves `*s` past `c` if that's what's there */
+static bool read_char(const char **s, char c);
+
+/* writes `n` out in decimal and returns the end of it */
+static char *write_int(char *s, int n);
+
+#define OTHER_PLAYER(player) ((player) == WHITE ? BLACK : WHITE)
+
+static uint64_t zobrist_pieces[2][6][64];
+static uint64_t zobrist_castling[16];
+static uint64_t zobrist_pessant[8];
+static uint64_t zobrist_black;
+
+static pthread_once_t engine_once = PTHREAD_ONCE_INIT;
 
 struct game *new_game(void) {
 	struct game *ret;
-	if ((ret = malloc(sizeof *ret)) == NULL) {
+	static const enum piece_type first_row[8] = {
+		ROOK, KNIGHT, BISHOP, QUEEN, KING, BISHOP, KNIGHT, ROOK
+	};
+
+	pthread_once(&engine_once, init_engine);
+
+	/* the mailbox is cache line aligned */
+	if ((ret = aligned_alloc(64, sizeof *ret)) == NULL) {
+		return NULL;
+	}
+	if ((ret->legal = malloc(sizeof *ret->legal)) == NULL) {
+		free(ret);
+		return NULL;
+	}
+	if ((ret->history = malloc(sizeof *ret->history)) == NULL) {
+		free(ret->legal);
+		free(ret);
 		return NULL;
 	}
 
 	ret->duration = 0;
-	ret->last_big_move = 0;
+	ret->halfmove = 0;
+	ret->castling = CASTLE_WHITE_KING | CASTLE_WHITE_QUEEN |
+		CASTLE_BLACK_KING | CASTLE_BLACK_QUEEN;
+	ret->pessant = -1;
 
+	memset(ret->board.squares, EMPTY, sizeof ret->board.squares);
 	for (int i = 0; i < 8; ++i) {
-		for (int j = 0; j < 8; ++j) {
-			ret->board.board[i][j].moves = 0;
-			ret->board.board[i][j].type = EMPTY;
-		}
+		ret->board.squares[SQUARE(0, i)] = PIECE(first_row[i], BLACK);
+		ret->board.squares[SQUARE(1, i)] = PIECE(PAWN, BLACK);
+		ret->board.squares[SQUARE(6, i)] = PIECE(PAWN, WHITE);
+		ret->board.squares[SQUARE(7, i)] = PIECE(first_row[i], WHITE);
 	}
 
-	for (int i = 0; i < 2; ++i) {
-		for (int j = 0; j < 8; ++j) {
-			ret->board.board[i][j].player = BLACK;
-			ret->board.board[7-i][j].player = WHITE;
-		}
-	}
-
-	for (int i = 0; i < 8; ++i) {
-		ret->board.board[1][i].type = PAWN;
-		ret->board.board[6][i].type = PAWN;
-	}
-
-#define FIRST_ROW_PIECE(index, ptype) \
-	ret->board.board[0][index].type = ptype; \
-	ret->board.board[0][7-index].type = ptype; \
-	ret->board.board[7][index].type = ptype; \
-	ret->board.board[7][7-index].type = ptype;
-	FIRST_ROW_PIECE(0, ROOK);
-	FIRST_ROW_PIECE(1, KNIGHT);
-	FIRST_ROW_PIECE(2, BISHOP);
-#undef FIRST_ROW_PIECE
-	ret->board.board[0][3].type = QUEEN;
-	ret->board.board[0][4].type = KING;
-	ret->board.board[7][3].type = QUEEN;
-	ret->board.board[7][4].type = KING;
+	sync_bitboards(&ret->board);
+	ret->hash = compute_hash(ret);
+	/* make sure that the cache doesn't match */
+	ret->legal->hash = ~ret->hash;
+	ret->history->len = 1;
+	ret->history->hashes[0] = ret->hash;
 
 	return ret;
 }
 
 void free_game(struct game *game) {
+	free(game->legal);
+	free(game->history);
 	free(game);
 }
 
-int make_move(struct game *game, struct move *move) {
-	int error_code;
-	enum player curr_player, other_player;
+void copy_game(struct game *dst, const struct game *src) {
+	struct legal_cache *legal = dst->legal;
+	struct history *history = dst->history;
+
+	*dst = *src;
+	dst->legal = legal;
+	dst->history = history;
+	*dst->history = *src->history;
+	/* the cached moves belong to whatever `dst` used to be */
+	dst->legal->hash = ~dst->hash;
+}
 
-	curr_player = get_player(game);
-	other_player = curr_player == WHITE ? BLACK : WHITE;
+int make_move(struct game *game, const struct move *move) {
+	int error_code, status;
 
 	error_code = make_move_no_checkmate(game, move);
 
@@ -153,662 +214,991 @@ int make_move(struct game *game, struct move *move) {
 		return error_code;
 	}
 
-	if (game->duration - game->last_big_move >= 150) {
+	/* nobody is waiting around for a claim, threefold repetition is
+	 * enough to end the game */
+	if (record_position(game) >= 3) {
 		return FORCED_DRAW;
 	}
 
-	if (game->duration - game->last_big_move >= 100) {
-		return DRAW_OFFER;
+	status = game_status(game);
+	return status != 0 ? status : error_code;
+}
+
+int game_status(struct game *game) {
+	enum player player = get_player(game), strong;
+
+	if (is_insufficient_material(game)) {
+		return FORCED_DRAW;
+	}
+
+	if (game->halfmove >= 150) {
+		return FORCED_DRAW;
 	}
 
-	if (!can_make_move(game, other_player)) {
-		if (is_in_check(game, other_player)) {
-			return curr_player == WHITE ?  WHITE_WIN : BLACK_WIN;
+	/* the same table will be used to check the other player's move. this
+	 * comes before the draw offer so that a game that can go on still has
+	 * its table, and so that a mate on the 100th halfmove still counts. */
+	if (legal_moves(game)->len == 0) {
+		if (is_in_check(game, player)) {
+			return player == WHITE ? BLACK_WIN : WHITE_WIN;
 		}
 		return FORCED_DRAW;
 	}
 
-	return error_code;
-}
+	if (game->halfmove >= 100) {
+		return DRAW_OFFER;
+	}
 
-static int make_move_no_checkmate(struct game *game, struct move *move) {
-	struct piece *captured;
-	struct move castle;
-	int error_code;
-	struct game backup;
-	enum player curr_player;
+	/* basic endgames are decided as soon as they show up, there's no point
+	 * in making both players play out a won KQK or a dead KPK */
+	switch (probe_bitbase(game, &strong)) {
+	case -1:
+		break;
+	case 0:
+		return FORCED_DRAW;
+	default:
+		return strong == WHITE ? WHITE_WIN : BLACK_WIN;
+	}
+
+	return 0;
+}
 
-	curr_player = get_player(game);
+static int record_position(struct game *game) {
+	struct history *history = game->history;
+	int ret = 1;
 
-	captured = NULL;
-	castle.r_i = castle.r_f = castle.c_i = castle.c_f = -1;
+	if (game->halfmove == 0) {
+		history->len = 0;
+	}
+	if (history->len < HISTORY_LEN) {
+		history->hashes[history->len++] = game->hash;
+	}
 
-	if ((error_code = is_illegal(game, move, &captured, &castle, curr_player)) < 0) {
-		return error_code;
+	/* only positions with the same player to move can match */
+	for (int i = history->len - 3; i >= 0; i -= 2) {
+		if (history->hashes[i] == game->hash) {
+			++ret;
+		}
 	}
+	return ret;
+}
 
-	memcpy(&backup, game, sizeof backup);
+static bool is_insufficient_material(const struct game *game) {
+	const struct board *board = &game->board;
+	uint64_t bishops;
+	int minors;
 
-	move_unchecked(game, move, captured, true);
-	if (castle.r_i != -1) {
-		move_unchecked(game, &castle, NULL, false);
+	if (board->count[WHITE][PAWN] || board->count[BLACK][PAWN] ||
+	    board->count[WHITE][ROOK] || board->count[BLACK][ROOK] ||
+	    board->count[WHITE][QUEEN] || board->count[BLACK][QUEEN]) {
+		return false;
 	}
 
-	if (is_in_check(game, curr_player)) {
-		memcpy(game, &backup, sizeof *game);
-		return ILLEGAL_MOVE;
+	/* a lone knight or bishop can't mate */
+	minors = board->count[WHITE][KNIGHT] + board->count[WHITE][BISHOP] +
+		board->count[BLACK][KNIGHT] + board->count[BLACK][BISHOP];
+	if (minors <= 1) {
+		return true;
+	}
+
+	/* and neither can any number of bishops that are all on the same
+	 * colour */
+	if (board->count[WHITE][KNIGHT] || board->count[BLACK][KNIGHT]) {
+		return false;
 	}
+	bishops = board->pieces[WHITE][BISHOP] | board->pieces[BLACK][BISHOP];
+	return !(bishops & LIGHT_SQUARES) || !(bishops & ~LIGHT_SQUARES);
+}
+
+static int make_move_no_checkmate(struct game *game, const struct move *move) {
+	struct move_list *list;
+	struct undo undo;
+	int i;
 
-	return error_code;
+	list = legal_moves(game);
+	if ((i = find_legal_move(list, move)) < 0) {
+		return i;
+	}
+	do_move(game, &list->moves[i], &undo);
+	return 0;
 }
 
-static int is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle, enum player player) {
-	struct piece *piece, *dst;
+int find_legal_move(const struct move_list *list, const struct move *move) {
+	bool is_promotion = false;
 
-	/* reject out-of-bounds moves */
-	if (is_oob(move->r_i, 0, 8) || is_oob(move->c_i, 0, 8) ||
-	    is_oob(move->r_f, 0, 8) || is_oob(move->c_f, 0, 8)) {
-		return ILLEGAL_MOVE;
+	for (int i = 0; i < list->len; ++i) {
+		const struct move *legal = &list->moves[i];
+		if (move_from(legal) != move_from(move) || move_to(legal) != move_to(move)) {
+			continue;
+		}
+		if (move_promotion(legal) == EMPTY ||
+		    move_promotion(legal) == move_promotion(move)) {
+			return i;
+		}
+		is_promotion = true;
 	}
 
-	PARSE_MOVE(game, move, piece, dst);
+	return is_promotion ? MISSING_PROMOTION : ILLEGAL_MOVE;
+}
+
+static int castle_is_illegal(const struct game *game, enum player player, int from, int cc,
+		uint64_t attacked) {
+	int right;
+	uint64_t between;
 
-	/* reject out of sequence moves */
-	if (piece->type == EMPTY || piece->player != player) {
+	if (player == WHITE) {
+		right = cc > 0 ? CASTLE_WHITE_KING : CASTLE_WHITE_QUEEN;
+	}
+	else {
+		right = cc > 0 ? CASTLE_BLACK_KING : CASTLE_BLACK_QUEEN;
+	}
+
+	/* the king or the rook has already moved. the rights only survive if
+	 * the king is on the e file and the rook is in the corner. */
+	if (!(game->castling & right)) {
 		return ILLEGAL_MOVE;
 	}
 
-	/* reject moves where white takes white or black takes black */
-	/* this also rejects noop moves like h4h4 */
-	if (dst->type != EMPTY && dst->player == piece->player) {
+	/* there's something in between the king and the rook */
+	between = cc > 0 ? BIT(from + 1) | BIT(from + 2) :
+		BIT(from - 1) | BIT(from - 2) | BIT(from - 3);
+	if (game->board.all & between) {
 		return ILLEGAL_MOVE;
 	}
 
-	switch (piece->type) {
-	case ROOK:
-		return rook_is_illegal(game, move, captured, castle);
-	case KNIGHT:
-		return knight_is_illegal(game, move, captured, castle);
-	case BISHOP:
-		return bishop_is_illegal(game, move, captured, castle);
-	case QUEEN:
-		return queen_is_illegal(game, move, captured, castle);
-	case KING:
-		return king_is_illegal(game, move, captured, castle);
-	case PAWN:
-		return pawn_is_illegal(game, move, captured, castle);
-	case EMPTY:
-		assert(false);
+	/* we're under attack*/
+	if (attacked & (BIT(from) | BIT(from + cc) | BIT(from + cc*2))) {
 		return ILLEGAL_MOVE;
 	}
 
-	return ILLEGAL_MOVE;
+	return 0;
 }
 
-static int rook_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle) {
-	int min, max;
+void do_move(struct game *game, const struct move *move, struct undo *undo) {
+	struct board *board = &game->board;
+	int from, to;
+	unsigned char piece;
+	enum piece_type type;
+	enum player player;
+
+	from = move_from(move);
+	to = move_to(move);
+	piece = board->squares[from];
+	type = PIECE_TYPE(piece);
+	player = PIECE_PLAYER(piece);
+
+	undo->move = *move;
+	undo->moved = piece;
+	undo->taken = board->squares[to];
+	undo->castling = game->castling;
+	undo->pessant = game->pessant;
+	undo->halfmove = game->halfmove;
+	undo->hash = game->hash;
+
+	++game->duration;
+	++game->halfmove;
+	game->hash ^= zobrist_black;
+
+	if (type == PAWN && to == game->pessant) {
+		int captured = SQUARE(ROW(from), COL(to));
+		remove_piece(board, captured);
+		game->hash ^= zobrist_pieces[OTHER_PLAYER(player)][PAWN][captured];
+	}
+	if (game->pessant != -1) {
+		game->hash ^= zobrist_pessant[COL(game->pessant)];
+		game->pessant = -1;
+	}
 
-	UNUSED(captured);
-	UNUSED(castle);
+	if (undo->taken != EMPTY) {
+		remove_piece(board, to);
+		game->hash ^= zobrist_pieces[PIECE_PLAYER(undo->taken)][PIECE_TYPE(undo->taken)][to];
+	}
+	if (undo->taken != EMPTY || type == PAWN) {
+		game->halfmove = 0;
+	}
 
-	if ((move->r_i - move->r_f) * (move->c_i - move->c_f) != 0) {
-		return ILLEGAL_MOVE;
+	remove_piece(board, from);
+	game->hash ^= zobrist_pieces[player][type][from];
+	if (type == PAWN && (ROW(to) == 0 || ROW(to) == 7)) {
+		type = move_promotion(move);
+	}
+	put_piece(board, to, PIECE(type, player));
+	game->hash ^= zobrist_pieces[player][type][to];
+
+	/* the rook's half of a castle */
+	if (type == KING && abs(to - from) == 2) {
+		int rook_from = to > from ? from + 3 : from - 4;
+		int rook_to = (from + to) / 2;
+		remove_piece(board, rook_from);
+		put_piece(board, rook_to, PIECE(ROOK, player));
+		game->hash ^= zobrist_pieces[player][ROOK][rook_from] ^
+			zobrist_pieces[player][ROOK][rook_to];
 	}
 
-	min = MIN(move->r_i, move->r_f);
-	max = MAX(move->r_i, move->r_f);
-	for (int i = min+1; i < max; ++i) {
-		if (game->board.board[i][move->c_i].type != EMPTY) {
-			return ILLEGAL_MOVE;
+	game->hash ^= zobrist_castling[game->castling];
+	game->castling &= ~(rights_lost(from) | rights_lost(to));
+	game->hash ^= zobrist_castling[game->castling];
+
+	if (type == PAWN && abs(to - from) == 16) {
+		game->pessant = usable_pessant(game, OTHER_PLAYER(player), (from + to) / 2);
+		if (game->pessant != -1) {
+			game->hash ^= zobrist_pessant[COL(game->pessant)];
 		}
 	}
+}
 
-	min = MIN(move->c_i, move->c_f);
-	max = MAX(move->c_i, move->c_f);
-	for (int i = min+1; i < max; ++i) {
-		if (game->board.board[move->r_i][i].type != EMPTY) {
-			return ILLEGAL_MOVE;
-		}
+void undo_move(struct game *game, struct undo *undo) {
+	struct board *board = &game->board;
+	int from, to;
+	enum piece_type type;
+	enum player player;
+
+	from = move_from(&undo->move);
+	to = move_to(&undo->move);
+	type = PIECE_TYPE(undo->moved);
+	player = PIECE_PLAYER(undo->moved);
+
+	if (type == KING && abs(to - from) == 2) {
+		int rook_from = to > from ? from + 3 : from - 4;
+		int rook_to = (from + to) / 2;
+		remove_piece(board, rook_to);
+		put_piece(board, rook_from, PIECE(ROOK, player));
 	}
 
-	return 0;
+	remove_piece(board, to);
+	put_piece(board, from, undo->moved);
+	if (undo->taken != EMPTY) {
+		put_piece(board, to, undo->taken);
+	}
+
+	if (type == PAWN && to == undo->pessant) {
+		put_piece(board, SQUARE(ROW(from), COL(to)), PIECE(PAWN, OTHER_PLAYER(player)));
+	}
+
+	--game->duration;
+	game->halfmove = undo->halfmove;
+	game->castling = undo->castling;
+	game->pessant = undo->pessant;
+	game->hash = undo->hash;
 }
 
-static int knight_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle) {
-	int dr, dc;
+static inline void put_piece(struct board *board, int sq, unsigned char piece) {
+	enum piece_type type = PIECE_TYPE(piece);
+	enum player player = PIECE_PLAYER(piece);
+
+	board->squares[sq] = piece;
+	board->pieces[player][type] |= BIT(sq);
+	board->occupied[player] |= BIT(sq);
+	board->all |= BIT(sq);
+	++board->count[player][type];
+	if (type == KING) {
+		board->king[player] = sq;
+	}
+}
 
-	UNUSED(game);
-	UNUSED(captured);
-	UNUSED(castle);
+static inline void remove_piece(struct board *board, int sq) {
+	enum piece_type type = PIECE_TYPE(board->squares[sq]);
+	enum player player = PIECE_PLAYER(board->squares[sq]);
+
+	board->squares[sq] = EMPTY;
+	board->pieces[player][type] &= ~BIT(sq);
+	board->occupied[player] &= ~BIT(sq);
+	board->all &= ~BIT(sq);
+	--board->count[player][type];
+	if (type == KING) {
+		board->king[player] = -1;
+	}
+}
 
-	dr = abs(move->r_f - move->r_i);
-	dc = abs(move->c_f - move->c_i);
+static void sync_bitboards(struct board *board) {
+	board->all = ~mailbox_empty(board->squares);
+	for (int player = 0; player < 2; ++player) {
+		board->occupied[player] = mailbox_player(board->squares, player);
+		board->king[player] = -1;
+		for (int type = 0; type < 6; ++type) {
+			uint64_t pieces = mailbox_match(board->squares, PIECE(type, player));
+			board->pieces[player][type] = pieces;
+			board->count[player][type] = popcount(pieces);
+			if (type == KING && pieces) {
+				board->king[player] = lsb(pieces);
+			}
+		}
+	}
+}
 
-	return (MIN(dr, dc) == 1 && MAX(dr, dc) == 2) ? 0 : ILLEGAL_MOVE;
+static void init_engine(void) {
+	init_bitboards();
+	init_zobrist();
 }
 
-static int bishop_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle) {
-	int dr, dc, cr, cc;
+static void init_zobrist(void) {
+	static bool initialized = false;
+	/* splitmix64 with a fixed seed, so hashes are the same from run to run */
+	uint64_t state = UINT64_C(0x636865737368); /* "chessh" */
+	uint64_t rights[4];
 
-	UNUSED(captured);
-	UNUSED(castle);
+#define NEXT_KEY(dst) \
+	do { \
+		uint64_t z = (state += UINT64_C(0x9e3779b97f4a7c15)); \
+		z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9); \
+		z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb); \
+		dst = z ^ (z >> 31); \
+	} while (0)
 
-	dr = move->r_f - move->r_i;
-	dc = move->c_f - move->c_i;
-	if (abs(dr) != abs(dc)) {
-		return ILLEGAL_MOVE;
+	if (initialized) {
+		return;
+	}
+	for (int p = 0; p < 2; ++p) {
+		for (int t = 0; t < 6; ++t) {
+			for (int sq = 0; sq < 64; ++sq) {
+				NEXT_KEY(zobrist_pieces[p][t][sq]);
+			}
+		}
+	}
+	/* each castling right gets its own key, a combination of rights is the
+	 * xor of its keys */
+	for (int i = 0; i < 4; ++i) {
+		NEXT_KEY(rights[i]);
 	}
+	for (int i = 0; i < 16; ++i) {
+		zobrist_castling[i] = 0;
+		for (int j = 0; j < 4; ++j) {
+			if (i & (1 << j)) {
+				zobrist_castling[i] ^= rights[j];
+			}
+		}
+	}
+	for (int i = 0; i < 8; ++i) {
+		NEXT_KEY(zobrist_pessant[i]);
+	}
+	NEXT_KEY(zobrist_black);
+#undef NEXT_KEY
+	initialized = true;
+}
 
-	cr = (dr < 0) ? -1 : 1;
-	cc = (dc < 0) ? -1 : 1;
+static uint64_t compute_hash(const struct game *game) {
+	uint64_t ret = 0;
 
-	int r = move->r_i + cr;
-	int c = move->c_i + cc;
-	while (r != move->r_f) {
-		if (game->board.board[r][c].type != EMPTY) {
-			return ILLEGAL_MOVE;
+	for (int p = 0; p < 2; ++p) {
+		for (int t = 0; t < 6; ++t) {
+			uint64_t pieces = game->board.pieces[p][t];
+			while (pieces) {
+				ret ^= zobrist_pieces[p][t][pop_lsb(&pieces)];
+			}
 		}
-		r += cr;
-		c += cc;
 	}
-	return 0;
+	if (get_player(game) == BLACK) {
+		ret ^= zobrist_black;
+	}
+	ret ^= zobrist_castling[game->castling];
+	if (game->pessant != -1) {
+		ret ^= zobrist_pessant[COL(game->pessant)];
+	}
+	return ret;
 }
 
-static int queen_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle) {
-	int dr, dc;
+static inline int rights_lost(int sq) {
+	switch (sq) {
+	case SQUARE(7, 4): return CASTLE_WHITE_KING | CASTLE_WHITE_QUEEN;
+	case SQUARE(7, 7): return CASTLE_WHITE_KING;
+	case SQUARE(7, 0): return CASTLE_WHITE_QUEEN;
+	case SQUARE(0, 4): return CASTLE_BLACK_KING | CASTLE_BLACK_QUEEN;
+	case SQUARE(0, 7): return CASTLE_BLACK_KING;
+	case SQUARE(0, 0): return CASTLE_BLACK_QUEEN;
+	default: return 0;
+	}
+}
 
-	UNUSED(castle);
+static int usable_pessant(const struct game *game, enum player player, int pessant) {
+	/* the pawn that just jumped is right in front of the en pessant
+	 * square from `player`'s point of view */
+	int jumped = pessant + (player == WHITE ? 8 : -8);
+	uint64_t ours = game->board.pieces[player][PAWN];
+	if ((shift_east(ours) | shift_west(ours)) & BIT(jumped)) {
+		return pessant;
+	}
+	return -1;
+}
+
+static inline __attribute__((always_inline))
+uint64_t attackers_to(const struct game *game, int sq, uint64_t occupied, enum player player) {
+	const uint64_t *them = game->board.pieces[OTHER_PLAYER(player)];
+
+	return (pawn_attacks(sq, player) & them[PAWN]) |
+	       (knight_attacks(sq) & them[KNIGHT]) |
+	       (king_attacks(sq) & them[KING]) |
+	       (bishop_attacks(sq, occupied) & (them[BISHOP] | them[QUEEN])) |
+	       (rook_attacks(sq, occupied) & (them[ROOK] | them[QUEEN]));
+}
 
-	dr = abs(move->r_f - move->r_i);
-	dc = abs(move->c_f - move->c_i);
-	if (dr * dc == 0) {
-		return rook_is_illegal(game, move, captured, castle);
+static bool is_in_check(const struct game *game, enum player player) {
+	/* somehow the king is gone? */
+	if (game->board.king[player] == -1) {
+		return true;
 	}
-	if (dr == dc) {
-		return bishop_is_illegal(game, move, captured, castle);
+	return attackers_to(game, game->board.king[player], game->board.all, player) != 0;
+}
+
+static struct move_list *legal_moves(struct game *game) {
+	if (game->legal->hash != game->hash) {
+		generate_moves(game, get_player(game), &game->legal->list);
+		game->legal->hash = game->hash;
 	}
-	return ILLEGAL_MOVE;
+	return &game->legal->list;
 }
 
-static int king_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle) {
-	int dr, dc;
-	int cc;
-	int c;
-	struct piece *piece, *rook;
+int generate_legal_moves(const struct game *game, struct move_list *list) {
+	return generate_moves(game, get_player(game), list);
+}
 
-	UNUSED(captured);
+static int generate_moves(const struct game *game, enum player player, struct move_list *list) {
+	if (player == WHITE) {
+		return generate_white_moves(game, list);
+	}
+	return generate_black_moves(game, list);
+}
 
-	dr = move->r_f - move->r_i;
-	dc = move->c_f - move->c_i;
+static int generate_white_moves(const struct game *game, struct move_list *list) {
+	return generate_moves_for(game, list, WHITE);
+}
 
-	/* regular king moves */
+static int generate_black_moves(const struct game *game, struct move_list *list) {
+	return generate_moves_for(game, list, BLACK);
+}
 
-	if (abs(dr) <= 1 && abs(dc) <= 1) {
+static inline __attribute__((always_inline))
+int generate_moves_for(const struct game *game, struct move_list *list, enum player player) {
+	enum player other_player = OTHER_PLAYER(player);
+	const uint64_t *ours = game->board.pieces[player];
+	const uint64_t *theirs = game->board.pieces[other_player];
+	uint64_t us = game->board.occupied[player];
+	uint64_t them = game->board.occupied[other_player];
+	uint64_t all = game->board.all;
+	uint64_t attacked, checkers, check_mask, pinned, snipers, pieces, targets;
+	uint64_t push, double_push, captures_east, captures_west;
+	int direction = player == WHITE ? -8 : 8;
+	int king, from, to;
+
+	list->len = 0;
+
+	king = game->board.king[player];
+	/* without a king every move leaves us "in check" */
+	if (king == -1) {
 		return 0;
 	}
 
-	/* castling */
+	/* the king is taken off of the board so that it can't hide from a
+	 * slider by stepping along the slider's ray. this doesn't change
+	 * anything for castling, which is only allowed out of check. */
+	attacked = attack_map(theirs, all ^ BIT(king), other_player);
 
-	piece = &game->board.board[move->r_i][move->c_i];
+	checkers = (attacked & BIT(king)) ? attackers_to(game, king, all, player) : 0;
 
-	/* the king has already moved or this would be an improper castle */
-	if (piece->moves != 0 ||
-	    dr != 0 ||
-	    abs(dc) != 2) {
-		return ILLEGAL_MOVE;
+	targets = king_attacks(king) & ~us & ~attacked;
+	while (targets) {
+		add_move(list, king, pop_lsb(&targets), EMPTY);
 	}
 
-	cc = (dc < 0) ? -1:1;
+	/* in double check only the king can move */
+	if (checkers & (checkers - 1)) {
+		return list->len;
+	}
 
-	/* find the next piece (presumably a rook) that goes in the proper
-	 * direction */
-	for (c = move->c_i + cc;
-			0 <= c &&
-			c <= 8 &&
-			game->board.board[move->r_i][c].type == EMPTY;
-			c += cc) ;
+	if (checkers) {
+		/* capture the checker or block it */
+		check_mask = checkers | between(king, lsb(checkers));
+	}
+	else {
+		check_mask = ~UINT64_C(0);
+		for (int cc = -1; cc <= 1; cc += 2) {
+			if (castle_is_illegal(game, player, king, cc, attacked) >= 0) {
+				add_move(list, king, king + cc*2, EMPTY);
+			}
+		}
+	}
 
-	/* there is no piece */
-	if (c < 0 || c >= 8) {
-		return ILLEGAL_MOVE;
+	/* a piece is pinned if it's the only thing standing between the king and
+	 * an enemy slider. it can still move along the line that it's pinned
+	 * on. */
+	pinned = 0;
+	snipers = (rook_attacks(king, them) & (theirs[ROOK] | theirs[QUEEN])) |
+		(bishop_attacks(king, them) & (theirs[BISHOP] | theirs[QUEEN]));
+	while (snipers) {
+		int sniper = pop_lsb(&snipers);
+		uint64_t blockers = between(king, sniper) & all;
+		if (blockers && !(blockers & (blockers - 1)) && (blockers & us)) {
+			pinned |= blockers;
+		}
 	}
 
-	rook = &game->board.board[move->r_i][c];
+#define ADD_TARGETS(attacks) \
+	do { \
+		targets = (attacks) & ~us & check_mask; \
+		if (pinned & BIT(from)) { \
+			targets &= line(king, from); \
+		} \
+		while (targets) { \
+			add_move(list, from, pop_lsb(&targets), EMPTY); \
+		} \
+	} while (0)
 
-	/* the next piece in the proper direction isn't a rook */
-	if (rook->type != ROOK) {
-		return ILLEGAL_MOVE;
+	/* a pinned knight can never move */
+	pieces = ours[KNIGHT] & ~pinned;
+	while (pieces) {
+		from = pop_lsb(&pieces);
+		ADD_TARGETS(knight_attacks(from));
 	}
-	/* the rook has already moved */
-	if (rook->moves != 0) {
-		return ILLEGAL_MOVE;
+
+	pieces = ours[BISHOP] | ours[QUEEN];
+	while (pieces) {
+		from = pop_lsb(&pieces);
+		ADD_TARGETS(bishop_attacks(from, all));
 	}
 
-	/* we're under attack*/
-	if (piece_is_attacked(game, move->r_i, move->c_i, piece->player) ||
-	    piece_is_attacked(game, move->r_i, move->c_i + cc, piece->player) ||
-	    piece_is_attacked(game, move->r_i, move->c_i + cc*2, piece->player)) {
-		return ILLEGAL_MOVE;
+	pieces = ours[ROOK] | ours[QUEEN];
+	while (pieces) {
+		from = pop_lsb(&pieces);
+		ADD_TARGETS(rook_attacks(from, all));
+	}
+#undef ADD_TARGETS
+
+	/* pawns that aren't pinned all move the same way, so they're moved
+	 * together */
+	pieces = ours[PAWN] & ~pinned;
+	if (player == WHITE) {
+		push = shift_north(pieces) & ~all;
+		double_push = shift_north(push & ROW_5) & ~all;
+		captures_east = shift_east(shift_north(pieces)) & them;
+		captures_west = shift_west(shift_north(pieces)) & them;
+	}
+	else {
+		push = shift_south(pieces) & ~all;
+		double_push = shift_south(push & ROW_2) & ~all;
+		captures_east = shift_east(shift_south(pieces)) & them;
+		captures_west = shift_west(shift_south(pieces)) & them;
 	}
 
-	castle->r_i = castle->r_f = move->r_i;
-	castle->c_i = c;;
-	castle->c_f = move->c_i + cc;
+#define ADD_PAWN_TARGETS(targets, offset) \
+	do { \
+		uint64_t remaining = (targets) & check_mask; \
+		while (remaining) { \
+			to = pop_lsb(&remaining); \
+			add_pawn_move(list, to - (offset), to); \
+		} \
+	} while (0)
 
-	return 0;
-}
+	ADD_PAWN_TARGETS(push, direction);
+	ADD_PAWN_TARGETS(double_push, direction*2);
+	ADD_PAWN_TARGETS(captures_east, direction + 1);
+	ADD_PAWN_TARGETS(captures_west, direction - 1);
+#undef ADD_PAWN_TARGETS
 
-static int pawn_is_illegal(struct game *game, struct move *move, struct piece **captured, struct move *castle) {
-	struct piece *piece, *dst;
-	int direction;
+	pieces = ours[PAWN] & pinned;
+	while (pieces) {
+		uint64_t allowed;
 
-	UNUSED(castle);
+		from = pop_lsb(&pieces);
+		allowed = check_mask & line(king, from);
 
-	PARSE_MOVE(game, move, piece, dst);
+		to = from + direction;
+		if (!(all & BIT(to))) {
+			if (allowed & BIT(to)) {
+				add_pawn_move(list, from, to);
+			}
+			to += direction;
+			if (ROW(from) == (player == WHITE ? 6 : 1) &&
+			    !(all & BIT(to)) && (allowed & BIT(to))) {
+				add_pawn_move(list, from, to);
+			}
+		}
 
-	if (piece->player == WHITE) {
-		noop();
+		targets = pawn_attacks(from, player) & them & allowed;
+		while (targets) {
+			add_pawn_move(list, from, pop_lsb(&targets));
+		}
 	}
 
-	direction = piece->player == WHITE ? -1 : 1;
-
-	/* Regular moves where pawns don't capture */
-	if (move->c_f == move->c_i) {
-		struct piece *p1, *p2;
+	/* en pessant takes a piece off of a square that the pawn doesn't land
+	 * on, so it gets its own check. it's legal as long as the king isn't
+	 * attacked once both pawns are gone. */
+	if (game->pessant != -1) {
+		pieces = pawn_attacks(game->pessant, OTHER_PLAYER(player)) & ours[PAWN];
+		while (pieces) {
+			int taken, from = pop_lsb(&pieces);
+			uint64_t occupied;
+
+			taken = SQUARE(ROW(from), COL(game->pessant));
+			occupied = (all ^ BIT(from) ^ BIT(taken)) | BIT(game->pessant);
+			if (!(checkers & ~BIT(taken) & (theirs[PAWN] | theirs[KNIGHT])) &&
+			    !(rook_attacks(king, occupied) & (theirs[ROOK] | theirs[QUEEN])) &&
+			    !(bishop_attacks(king, occupied) & (theirs[BISHOP] | theirs[QUEEN]))) {
+				add_move(list, from, game->pessant, EMPTY);
+			}
+		}
+	}
 
-		p1 = &game->board.board[move->r_i+direction][move->c_i];
-		p2 = &game->board.board[move->r_i+direction*2][move->c_i];
+	return list->len;
+}
 
-		if (p1->type != EMPTY) {
-			return ILLEGAL_MOVE;
-		}
-		if (move->r_i + direction == move->r_f) {
-			goto promote_pawn;
-		}
-		if (move->r_i + direction*2 == move->r_f &&
-		    p2->type == EMPTY &&
-		    piece->moves == 0) {
-			goto promote_pawn;
-		}
+static inline void add_move(struct move_list *list, int from, int to, enum piece_type promotion) {
+	list->moves[list->len++] = new_move(ROW(from), COL(from), ROW(to), COL(to), promotion);
+}
 
-		return ILLEGAL_MOVE;
+static inline void add_pawn_move(struct move_list *list, int from, int to) {
+	if (ROW(to) != 0 && ROW(to) != 7) {
+		add_move(list, from, to, EMPTY);
+		return;
 	}
+	add_move(list, from, to, ROOK);
+	add_move(list, from, to, KNIGHT);
+	add_move(list, from, to, BISHOP);
+	add_move(list, from, to, QUEEN);
+}
 
-	/* Pawn capture moves */
-	if (abs(move->c_f - move->c_i) == 1) {
-		struct piece *pessant;
-
-		if (move->r_i + direction != move->r_f) {
-			return ILLEGAL_MOVE;
-		}
+enum player get_player(const struct game *game) {
+	return game->duration % 2 == 0 ? WHITE : BLACK;
+}
 
-		pessant = &game->board.board[move->r_i][move->c_f];
-		if (dst->type != EMPTY) {
-			goto promote_pawn;
-		}
+struct piece get_piece(const struct game *game, int row, int col) {
+	struct piece ret;
+	unsigned char piece = game->board.squares[SQUARE(row, col)];
+	ret.type = PIECE_TYPE(piece);
+	ret.player = PIECE_PLAYER(piece);
+	return ret;
+}
 
-		/* en pessant */
+uint64_t get_checkers(const struct game *game) {
+	enum player player = get_player(game);
+	int king = game->board.king[player];
 
-		if (pessant->type == PAWN &&
-		    pessant->player != piece->player &&
-		    pessant->moves == 1 &&
-		    ((piece->player == WHITE && move->r_i == 3) ||
-		     (piece->player == BLACK && move->r_i == 4)) &&
-		    pessant->last_move == game->duration) {
-			*captured = pessant;
-			goto promote_pawn;
-		}
-		return ILLEGAL_MOVE;
+	if (king == -1) {
+		return 0;
 	}
+	return attackers_to(game, king, game->board.all, player);
+}
 
-	return ILLEGAL_MOVE;
-promote_pawn:
+uint64_t game_hash(const struct game *game) {
+	return game->hash;
+}
 
-	if ((piece->player == WHITE && move->r_f == 0) ||
-	    (piece->player == BLACK && move->r_f == 7)) {
-		switch (move->promotion) {
-		case ROOK: case KNIGHT: case BISHOP: case QUEEN:
-			piece->type = move->promotion;
-			break;
-		default:
-			return MISSING_PROMOTION;
-		}
+int init_game(struct game *game, const char *state) {
+	const char *next;
+	if (parse_fen(game, state, &next) < 0 || *next != '\0') {
+		return -1;
 	}
 	return 0;
 }
 
-static void move_unchecked(struct game *game, struct move *move, struct piece *captured, bool should_advance_clock) {
-	struct piece *src, *dst;
+int parse_fen(struct game *game, const char *fen, const char **next) {
+	const char *s = fen;
+	int ret = read_fen(game, &s);
 
-	PARSE_MOVE(game, move, src, dst);
-	if (should_advance_clock) {
-		++game->duration;
-	}
-	if (dst->type != EMPTY || captured != NULL) {
-		game->last_big_move = game->duration;
+	/* whatever went wrong, the next FEN starts on the next line */
+	if (*s != '\0' && *s != '\n') {
+		ret = -1;
+		s += strcspn(s, "\n");
 	}
-	if (captured != NULL) {
-		captured->type = EMPTY;
-	}
-	memcpy(dst, src, sizeof *dst);
-	++dst->moves;
-	dst->last_move = game->duration;
-	src->type = EMPTY;
+	*next = *s == '\n' ? s + 1 : s;
+	return ret;
 }
 
-static bool piece_is_attacked(struct game *game, int r, int c, enum player player) {
-	enum player other_player = player == WHITE ? BLACK : WHITE;
-	bool ret = false;
-	enum piece_type old_type;
-	old_type = game->board.board[r][c].type;
+static int read_fen(struct game *game, const char **s) {
+	struct board *board = &game->board;
+	enum player player;
 
-	/* If a pawn attacks an empty piece, `is_illegal` will think that that
-	 * empty space is safe, even though a piece that moves there is
-	 * attacked. */
-	if (old_type == EMPTY) {
-		game->board.board[r][c].type = PAWN;
-		game->board.board[r][c].player = player;
+	if (read_placement(board, s) < 0) {
+		return -1;
 	}
-	for (int i = 0; i < 8; ++i) {
-		for (int j = 0; j < 8; ++j) {
-			struct move move;
-			struct piece *captured;
-			struct move castle;
+	sync_bitboards(board);
 
-			if (game->board.board[i][j].type == EMPTY ||
-			    game->board.board[i][j].player == player) {
-				continue;
-			}
-
-			captured = NULL;
-			castle.r_i = castle.c_i = castle.r_f = castle.c_f = -1;
-			move.r_i = i;
-			move.c_i = j;
-			move.r_f = r;
-			move.c_f = c;
-			move.promotion = QUEEN;
-			if (is_illegal(game, &move, &captured, &castle, other_player) >= 0) {
-				ret = true;
-				goto end;
-			}
-		}
+	/* exactly one king each, and no pawns on the first or last row */
+	if (board->count[WHITE][KING] != 1 || board->count[BLACK][KING] != 1) {
+		return -1;
+	}
+	if ((board->pieces[WHITE][PAWN] | board->pieces[BLACK][PAWN]) & (ROW_0 | ROW_7)) {
+		return -1;
 	}
-	ret = false;
-end:
-	game->board.board[r][c].type = old_type;
-	return ret;
-}
 
-static bool is_in_check(struct game *game, enum player player) {
-	int kr, kc;
-	for (kr = 0; kr < 8; ++kr) {
-		for (kc = 0; kc < 8; ++kc) {
-			if (game->board.board[kr][kc].type == KING &&
-			    game->board.board[kr][kc].player == player) {
-				goto found_king;
-			}
-		}
+	if (!read_char(s, ' ')) {
+		return -1;
 	}
-	/* somehow the king is gone? */
-	return true;
-found_king:
-	return piece_is_attacked(game, kr, kc, player);
-}
+	if (read_char(s, 'w')) {
+		game->duration = 0;
+	}
+	else if (read_char(s, 'b')) {
+		game->duration = 1;
+	}
+	else {
+		return -1;
+	}
+	player = get_player(game);
 
-static bool can_make_move(struct game *game, enum player player) {
-	for (int i = 0; i < 8; ++i) {
-		for (int j = 0; j < 8; ++j){
-			if (game->board.board[i][j].type == EMPTY ||
-			    game->board.board[i][j].player != player) {
-				continue;
-			}
-			if (piece_can_move(game, i, j)) {
-				return true;
-			}
-		}
+	/* the player who just moved can't have left their king in check */
+	if (is_in_check(game, OTHER_PLAYER(player))) {
+		return -1;
 	}
-	return false;
-}
 
-static bool piece_can_move(struct game *game, int row, int col) {
-	for (int i = 0; i < 8; ++i) {
-		for (int j = 0; j < 8; ++j) {
-			struct move move;
-			move.r_i = row;
-			move.c_i = col;
-			move.r_f = i;
-			move.c_f = j;
-			move.promotion = QUEEN;
-			if (make_move_dryrun(game, &move) >= 0) {
-				return true;
-			}
-		}
+	if (!read_char(s, ' ') || read_castling(game, s) < 0 ||
+	    !read_char(s, ' ') || read_pessant(game, s) < 0 ||
+	    read_clocks(game, s) < 0) {
+		return -1;
 	}
-	return false;
+
+	game->hash = compute_hash(game);
+	game->history->len = 1;
+	game->history->hashes[0] = game->hash;
+
+	return 0;
 }
 
-enum player get_player(struct game *game) {
-	return game->duration % 2 == 0 ? WHITE : BLACK;
+static bool read_char(const char **s, char c) {
+	if (**s != c) {
+		return false;
+	}
+	++*s;
+	return true;
 }
 
-int init_game(struct game *game, char *state) {
-	int r, c, i, duration;
-	char ch;
+static int read_placement(struct board *board, const char **s) {
+	int r = 0, c = 0;
+	unsigned char piece;
 
-	r = c = 0;
-	for (i = 0; state[i] != ' '; ++i) {
-		switch (tolower(state[i])) {
+	memset(board->squares, EMPTY, sizeof board->squares);
+	for (;; ++*s) {
+		char ch = **s;
+		if (ch >= '1' && ch <= '8') {
+			if ((c += ch - '0') > 8) {
+				return -1;
+			}
+			continue;
+		}
+		switch (ch) {
 		case '/':
-			if (c != 8) {
+			if (c != 8 || r >= 7) {
 				return -1;
 			}
 			++r;
 			c = 0;
 			continue;
-		case 'r':
-			game->board.board[r][c].type = ROOK;
-			goto finish_generic;
-		case 'n':
-			game->board.board[r][c].type = KNIGHT;
-			goto finish_generic;
-		case 'b':
-			game->board.board[r][c].type = BISHOP;
-			goto finish_generic;
-		case 'q':
-			game->board.board[r][c].type = QUEEN;
-			goto finish_generic;
-		case 'k':
-			game->board.board[r][c].type = KING;
-			game->board.board[r][c].moves = 0;
-			goto finish_special;
-		case 'p':
-			game->board.board[r][c].type = PAWN;
-			game->board.board[r][c].moves = islower(state[i]) ?
-				(r == 1 ? 0:1) :
-				(r == 6 ? 0:1);
-			goto finish_special;
-		finish_generic:
-			game->board.board[r][c].moves = 1;
-			/* fallthrough */
-		finish_special:
-			game->board.board[r][c].player = islower(state[i]) ? BLACK : WHITE;
-			game->board.board[r][c].last_move = 0;
-			++c;
-			break;
-		digit:
-			for (int o = 0; o < state[i] - '0'; ++o) {
-				if (c >= 8) {
-					return -1;
-				}
-				game->board.board[r][c++].type = EMPTY;
-			}
-			break;
+		case 'R': piece = PIECE(ROOK, WHITE); break;
+		case 'N': piece = PIECE(KNIGHT, WHITE); break;
+		case 'B': piece = PIECE(BISHOP, WHITE); break;
+		case 'Q': piece = PIECE(QUEEN, WHITE); break;
+		case 'K': piece = PIECE(KING, WHITE); break;
+		case 'P': piece = PIECE(PAWN, WHITE); break;
+		case 'r': piece = PIECE(ROOK, BLACK); break;
+		case 'n': piece = PIECE(KNIGHT, BLACK); break;
+		case 'b': piece = PIECE(BISHOP, BLACK); break;
+		case 'q': piece = PIECE(QUEEN, BLACK); break;
+		case 'k': piece = PIECE(KING, BLACK); break;
+		case 'p': piece = PIECE(PAWN, BLACK); break;
 		default:
-			if (isdigit(state[i])) {
-				goto digit;
-			}
+			return r == 7 && c == 8 ? 0 : -1;
+		}
+		if (c >= 8) {
 			return -1;
 		}
+		board->squares[SQUARE(r, c++)] = piece;
 	}
+}
 
-	if (r < 7 || c < 7) {
-		return -1;
-	}
-	if (state[i] != ' ') {
-		return -1;
-	}
-
-	switch (state[++i]) {
-	case 'w':
-		game->duration = 0;
-		break;
-	case 'b':
-		game->duration = 1;
-		break;
-	default:
-		return -1;
-	}
-
-	if (state[++i] != ' ') {
-		return -1;
+static int read_castling(struct game *game, const char **s) {
+	game->castling = 0;
+	if (read_char(s, '-')) {
+		return 0;
 	}
-
-	for (;;) {
-		char c = state[++i];
-		switch (c) {
-#define ROOK_CASTLE(ch, r, c, p) \
+	for (;; ++*s) {
+		switch (**s) {
+#define ROOK_CASTLE(ch, right, r, c, p) \
 		case ch: \
-			if (game->board.board[r][c].type != ROOK || \
-			    game->board.board[r][c].player != p) { \
+			if (game->board.squares[SQUARE(r, c)] != PIECE(ROOK, p) || \
+			    game->board.squares[SQUARE(r, 4)] != PIECE(KING, p) || \
+			    (game->castling & right)) { \
 				return -1; \
 			} \
-			game->board.board[r][c].moves = 0; \
+			game->castling |= right; \
 			break
-		ROOK_CASTLE('K', 7, 7, WHITE);
-		ROOK_CASTLE('Q', 7, 0, WHITE);
-		ROOK_CASTLE('k', 0, 7, BLACK);
-		ROOK_CASTLE('q', 0, 0, BLACK);
+		ROOK_CASTLE('K', CASTLE_WHITE_KING, 7, 7, WHITE);
+		ROOK_CASTLE('Q', CASTLE_WHITE_QUEEN, 7, 0, WHITE);
+		ROOK_CASTLE('k', CASTLE_BLACK_KING, 0, 7, BLACK);
+		ROOK_CASTLE('q', CASTLE_BLACK_QUEEN, 0, 0, BLACK);
 #undef ROOK_CASTLE
-		case '-':
-			if (state[++i] != ' ') {
-				return -1;
-			}
-			/* fallthrough */
-		case ' ':
-			goto got_castles;
 		default:
-			return -1;
+			return game->castling ? 0 : -1;
 		}
 	}
-got_castles:
-
-	/* We're reusing variable names! [r, c] is now the location of the en
-	 * pessant pawn */
-	switch (ch = state[++i]) {
-	case '-':
-		r = c = -1;
-		goto no_en_pessant;
-	case 'a': c = 0; break;
-	case 'b': c = 1; break;
-	case 'c': c = 2; break;
-	case 'd': c = 3; break;
-	case 'e': c = 4; break;
-	case 'f': c = 5; break;
-	case 'g': c = 6; break;
-	case 'h': c = 7; break;
-	default:
-		  return -1;
-	}
+}
 
-	switch (ch = state[++i]) {
-	case '2': r = 3; break;
-	case '5': r = 4; break;
-	}
-no_en_pessant:
+static int read_pessant(struct game *game, const char **s) {
+	enum player player = get_player(game);
+	int r, c, sq, forward;
 
-	switch (state[++i]) {
-	case ' ':
-		break;
-	case '\0':
-		game->last_big_move = duration = 0;
-		goto got_clock;
-	default:
-		return -1;
+	game->pessant = -1;
+	if (read_char(s, '-')) {
+		return 0;
 	}
 
-	if ((game->last_big_move = parse_int(state, ++i, &i)) == -1) {
+	if ((c = **s - 'a') < 0 || c >= 8) {
 		return -1;
 	}
-	game->last_big_move *= -1;
-
-	if (state[i++] != ' ') {
+	++*s;
+	/* the square has to be behind a pawn that just jumped */
+	r = player == WHITE ? 2 : 5;
+	if (!read_char(s, player == WHITE ? '6' : '3')) {
 		return -1;
 	}
-
-	if ((duration = parse_int(state, i, &i)-1) < 0) {
+	sq = SQUARE(r, c);
+	/* and the pawn jumped over it from the square behind, so both of
+	 * those have to be empty */
+	forward = player == WHITE ? 8 : -8;
+	if (!(game->board.pieces[OTHER_PLAYER(player)][PAWN] & BIT(sq + forward)) ||
+	    (game->board.all & (BIT(sq) | BIT(sq - forward)))) {
 		return -1;
 	}
-	duration *= 2;
+	game->pessant = usable_pessant(game, player, sq);
+	return 0;
+}
 
-got_clock:
-	game->duration += duration;
-	game->board.board[r][c].last_move += game->duration;
-	game->last_big_move += duration;
+static int read_clocks(struct game *game, const char **s) {
+	int halfmove, fullmove;
 
-	if (state[i] != '\0') {
-		return -1;
+	/* the clocks are optional */
+	if (**s == '\0' || **s == '\n') {
+		game->halfmove = 0;
+		return 0;
 	}
 
+	if (!read_char(s, ' ') || (halfmove = read_int(s)) < 0 ||
+	    !read_char(s, ' ') || (fullmove = read_int(s)) < 1) {
+		return -1;
+	}
+	game->halfmove = halfmove;
+	game->duration += (fullmove - 1) * 2;
 	return 0;
 }
 
-static int parse_int(char *s, int start, int *end) {
-	int i, ret;
-	ret = 0;
-	if (!isdigit(s[start])) {
+static int read_int(const char **s) {
+	int ret = 0;
+	if (!isdigit(**s)) {
 		return -1;
 	}
-	for (i = start; isdigit(s[i]); ++i) {
-		ret *= 10;
-		ret += s[i] - '0';
+	while (isdigit(**s)) {
+		/* no game is anywhere near this long */
+		if (ret >= 100000) {
+			return -1;
+		}
+		ret = ret * 10 + *(*s)++ - '0';
+	}
+	return ret;
+}
+
+char *game_to_fen(const struct game *game, char ret[FEN_MAX_LEN]) {
+	/* indexed by the mailbox byte */
+	static const char symbols[16] = "RNBQKP  rnbqkp  ";
+	char *s = ret;
+
+	for (int r = 0; r < 8; ++r) {
+		int empty = 0;
+		for (int c = 0; c < 8; ++c) {
+			unsigned char piece = game->board.squares[SQUARE(r, c)];
+			if (piece == EMPTY) {
+				++empty;
+				continue;
+			}
+			if (empty) {
+				*s++ = '0' + empty;
+				empty = 0;
+			}
+			*s++ = symbols[piece];
+		}
+		if (empty) {
+			*s++ = '0' + empty;
+		}
+		*s++ = r == 7 ? ' ' : '/';
+	}
+
+	*s++ = get_player(game) == WHITE ? 'w' : 'b';
+	*s++ = ' ';
+
+	if (game->castling == 0) {
+		*s++ = '-';
 	}
-	*end = i;
+	if (game->castling & CASTLE_WHITE_KING)  *s++ = 'K';
+	if (game->castling & CASTLE_WHITE_QUEEN) *s++ = 'Q';
+	if (game->castling & CASTLE_BLACK_KING)  *s++ = 'k';
+	if (game->castling & CASTLE_BLACK_QUEEN) *s++ = 'q';
+	*s++ = ' ';
+
+	/* this is only set when the capture is actually possible, which is
+	 * all that FEN needs */
+	if (game->pessant == -1) {
+		*s++ = '-';
+	}
+	else {
+		*s++ = COL(game->pessant) + 'a';
+		*s++ = 8 - ROW(game->pessant) + '0';
+	}
+	*s++ = ' ';
+
+	s = write_int(s, game->halfmove);
+	*s++ = ' ';
+	s = write_int(s, game->duration / 2 + 1);
+	*s = '\0';
 	return ret;
 }
 
-int parse_move(struct game *game, char *move) {
+static char *write_int(char *s, int n) {
+	char digits[12];
+	int len = 0;
+	do {
+		digits[len++] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	while (len) {
+		*s++ = digits[--len];
+	}
+	return s;
+}
+
+int parse_move(struct game *game, const char *move) {
 	struct move move_s;
+	int r_i, c_i, r_f, c_f;
+	enum piece_type promotion;
 	if (strlen(move) < 4) {
 		return ILLEGAL_MOVE;
 	}
-	move_s.c_i = tolower(move[0]) - 'a';
-	move_s.r_i = 8 - (move[1] - '0');
-	move_s.c_f = tolower(move[2]) - 'a';
-	move_s.r_f = 8 - (move[3] - '0');
-	move_s.promotion = EMPTY;
+	c_i = tolower(move[0]) - 'a';
+	r_i = 8 - (move[1] - '0');
+	c_f = tolower(move[2]) - 'a';
+	r_f = 8 - (move[3] - '0');
+
+	/* reject out-of-bounds moves */
+	if (is_oob(r_i, 0, 8) || is_oob(c_i, 0, 8) ||
+	    is_oob(r_f, 0, 8) || is_oob(c_f, 0, 8)) {
+		return ILLEGAL_MOVE;
+	}
+
+	promotion = EMPTY;
 	switch (tolower(move[4])) {
-	case 'n': move_s.promotion = KNIGHT; break;
-	case 'q': move_s.promotion = QUEEN;  break;
-	case 'r': move_s.promotion = ROOK;   break;
-	case 'b': move_s.promotion = BISHOP; break;
+	case 'n': promotion = KNIGHT; break;
+	case 'q': promotion = QUEEN;  break;
+	case 'r': promotion = ROOK;   break;
+	case 'b': promotion = BISHOP; break;
 	}
+	move_s = new_move(r_i, c_i, r_f, c_f, promotion);
 	return make_move(game, &move_s);
 }
 
-char *move_to_string(struct move *move) {
-	char *ret;
-	if ((ret = malloc(6)) == NULL) {
-		return NULL;
-	}
-	ret[0] = move->c_i + 'a';
-	ret[1] = 8-move->r_i + '0';
-	ret[2] = move->c_f + 'a';
-	ret[3] = 8-move->r_f + '0';
-	if (move->promotion == EMPTY) {
+char *move_to_string(const struct move *move, char ret[MOVE_STRING_LEN]) {
+	ret[0] = COL(move_from(move)) + 'a';
+	ret[1] = 8-ROW(move_from(move)) + '0';
+	ret[2] = COL(move_to(move)) + 'a';
+	ret[3] = 8-ROW(move_to(move)) + '0';
+	if (move_promotion(move) == EMPTY) {
 		ret[4] = '\0';
 		return ret;
 	}
-	ret[4] = piece_to_char(move->promotion);
+	ret[4] = piece_to_char(move_promotion(move));
 	ret[5] = '\0';
 	return ret;
 }
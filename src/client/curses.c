@@ -26,8 +26,15 @@
 
 #include <client/frontend.h>
 
+/* the squares that the player has picked so far, a `struct move` is only built
+ * once they're all filled in */
+struct selection {
+	int r_i, c_i, r_f, c_f;
+	enum piece_type promotion;
+};
+
 struct aux {
-	struct move move;
+	struct selection move;
 	wchar_t **piecesyms_white;
 	wchar_t **piecesyms_black;
 	bool has_color;
@@ -42,7 +49,7 @@ struct aux {
 
 #define CREDIT "made by nate choe <nate@natechoe.dev>, https://github.com/natechoe1/chessh"
 
-static char *get_move(void *aux, enum player player);
+static int get_move(void *aux, enum player player, char buff[MOVE_STRING_LEN]);
 static void select_square(int *r_ret, int *c_ret, enum player player);
 static void report_error(void *aux, int code);
 static void report_msg(void *aux, char *msg);
@@ -50,7 +57,7 @@ static void draw_piece(struct aux *aux, struct game *game, int row, int col);
 static void display_board(void *aux, struct game *game, enum player player);
 static void show_credit();
 static void free_frontend(struct frontend *this);
-static void reset_move(struct move *move);
+static void reset_move(struct selection *move);
 static void drawmsg(struct aux *aux, char *msg);
 
 struct frontend *new_curses_frontend(wchar_t **piecesyms_white, wchar_t **piecesyms_black) {
@@ -95,9 +102,10 @@ struct frontend *new_curses_frontend(wchar_t **piecesyms_white, wchar_t **pieces
 	return ret;
 }
 
-static char *get_move(void *aux, enum player player) {
+static int get_move(void *aux, enum player player, char buff[MOVE_STRING_LEN]) {
 	struct aux *aux_decomposed = (struct aux *) aux;
-	struct move *move;
+	struct selection *move;
+	struct move move_s;
 	move = &aux_decomposed->move;
 	if (move->promotion != EMPTY) {
 		goto end;
@@ -109,9 +117,11 @@ static char *get_move(void *aux, enum player player) {
 	select_square(&move->r_f, &move->c_f, player);
 
 end:
+	move_s = new_move(move->r_i, move->c_i, move->r_f, move->c_f, move->promotion);
 	/* Reset the promotion for the next move */
 	aux_decomposed->move.promotion = EMPTY;
-	return move_to_string(move);
+	move_to_string(&move_s, buff);
+	return 0;
 }
 
 static void select_square(int *r_ret, int *c_ret, enum player player) {
@@ -178,7 +188,8 @@ static void report_msg(void *aux, char *msg) {
 }
 
 static void draw_piece(struct aux *aux, struct game *game, int row, int col) {
-	struct piece *piece = &game->board.board[row][col];
+	struct piece piece_s = get_piece(game, row, col);
+	struct piece *piece = &piece_s;
 	int white_foreground, white_background;
 	int pair;
 	white_background = (row+col)%2 == 0;
@@ -240,7 +251,7 @@ static void free_frontend(struct frontend *this) {
 	free(this);
 }
 
-static void reset_move(struct move *move) {
+static void reset_move(struct selection *move) {
 	move->r_i = move->c_i = move->r_f = move->c_f = -1;
 	move->promotion = EMPTY;
 }
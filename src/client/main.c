@@ -16,7 +16,9 @@
  * */
 
 #include <stdio.h>
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <getopt.h>
 
@@ -30,13 +32,15 @@ struct client_args {
 	char *user;
 	char *pass;
 
-	int perft;
-	char *start_pos;
-	char *start_sequence;
-	bool autotest;
+	/* perft.level is -1 unless a perft test was asked for, or one is being
+	 * resumed, or worked on for somebody else */
+	struct perft_options perft;
 };
 
 static void parse_args(int argc, char *argv[], struct client_args *ret);
+/* returns `arg` as a number, or quits with an error if it isn't a whole number
+ * that's at least `min`. `flag` is the option that it came with. */
+static int parse_number(char *progname, char flag, const char *arg, int min);
 static void print_help(char *progname);
 
 int main(int argc, char *argv[]) {
@@ -46,8 +50,8 @@ int main(int argc, char *argv[]) {
 
 	parse_args(argc, argv, &args);
 
-	if (args.perft != -1) {
-		return run_perft(args.perft, args.start_pos, args.start_sequence, args.autotest);
+	if (args.perft.level != -1 || args.perft.resume || args.perft.worker != NULL) {
+		return run_perft(&args.perft);
 	}
 
 	snprintf(sock_path, sizeof sock_path, "%s/matchmaker", args.dir);
@@ -61,12 +65,18 @@ int main(int argc, char *argv[]) {
 
 static void parse_args(int argc, char *argv[], struct client_args *ret) {
 	ret->dir = ret->user = ret->pass = NULL;
-	ret->perft = -1;
-	ret->start_pos = ret->start_sequence = NULL;
-	ret->autotest = false;
+	ret->perft.level = -1;
+	ret->perft.start_pos = ret->perft.start_sequence = NULL;
+	ret->perft.autotest = false;
+	ret->perft.table_mb = 0;
+	ret->perft.threads = 1;
+	ret->perft.format = PERFT_PLAIN;
+	ret->perft.checkpoint = NULL;
+	ret->perft.resume = false;
+	ret->perft.coordinator = ret->perft.worker = NULL;
 
 	for (;;) {
-		int opt = getopt(argc, argv, "hld:u:p:t:i:s:a");
+		int opt = getopt(argc, argv, "hld:u:p:t:i:s:aH:j:x:C:R:D:W:");
 		switch (opt) {
 		case -1:
 			goto got_args;
@@ -86,16 +96,50 @@ static void parse_args(int argc, char *argv[], struct client_args *ret) {
 			ret->pass = optarg;
 			break;
 		case 't':
-			ret->perft = atoi(optarg);
+			/* there's no such thing as a 0 level test, and -1 already
+			 * means that there isn't one */
+			ret->perft.level = parse_number(argv[0], opt, optarg, 1);
 			break;
 		case 'i':
-			ret->start_pos = optarg;
+			ret->perft.start_pos = optarg;
 			break;
 		case 's':
-			ret->start_sequence = optarg;
+			ret->perft.start_sequence = optarg;
 			break;
 		case 'a':
-			ret->autotest = true;
+			ret->perft.autotest = true;
+			break;
+		case 'H':
+			/* 0 turns the table off */
+			ret->perft.table_mb = parse_number(argv[0], opt, optarg, 0);
+			break;
+		case 'j':
+			ret->perft.threads = parse_number(argv[0], opt, optarg, 1);
+			break;
+		case 'x':
+			if (strcmp(optarg, "table") == 0) {
+				ret->perft.format = PERFT_TABLE;
+			}
+			else if (strcmp(optarg, "csv") == 0) {
+				ret->perft.format = PERFT_CSV;
+			}
+			else {
+				fprintf(stderr, "%s: unknown perft format %s\n", argv[0], optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'C':
+			ret->perft.checkpoint = optarg;
+			break;
+		case 'R':
+			ret->perft.checkpoint = optarg;
+			ret->perft.resume = true;
+			break;
+		case 'D':
+			ret->perft.coordinator = optarg;
+			break;
+		case 'W':
+			ret->perft.worker = optarg;
 			break;
 		default:
 			print_help(argv[0]);
@@ -104,7 +148,7 @@ static void parse_args(int argc, char *argv[], struct client_args *ret) {
 	}
 got_args:
 
-	if (ret->perft != -1) {
+	if (ret->perft.level != -1 || ret->perft.resume || ret->perft.worker != NULL) {
 		return;
 	}
 
@@ -115,6 +159,18 @@ got_args:
 	}
 }
 
+static int parse_number(char *progname, char flag, const char *arg, int min) {
+	char *end;
+	long ret = strtol(arg, &end, 10);
+
+	if (end == arg || *end != '\0' || ret < min || ret > INT_MAX) {
+		fprintf(stderr, "%s: -%c takes a whole number that's at least %d, got %s\n",
+				progname, flag, min, arg);
+		exit(EXIT_FAILURE);
+	}
+	return ret;
+}
+
 static void print_help(char *progname) {
 	printf("Usage: %s -d [dir] -u [username] -p [password]\n"
 	       "OTHER FLAGS:\n"
@@ -123,6 +179,13 @@ static void print_help(char *progname) {
 	       "  -t [level]: Run a perft test with [level] levels\n"
 	       "  -i [start]: Use [start] as the starting position for the perft test\n"
 	       "  -s [sequence]: Run [sequence] before beginning the perft test\n"
-	       "  -a: Produce a test output suitable for automatic testing with perftree\n",
+	       "  -a: Produce a test output suitable for automatic testing with perftree\n"
+	       "  -H [size]: Cache perft results in a [size] MB hash table\n"
+	       "  -j [threads]: Split the perft test across [threads] threads\n"
+	       "  -x [format]: Break the perft results down by move type, as a table or csv\n"
+	       "  -C [file]: Save the perft test's progress to [file] as it goes\n"
+	       "  -R [file]: Resume the perft test saved in [file]\n"
+	       "  -D [socket]: Hand the perft test out to workers that connect to [socket]\n"
+	       "  -W [socket]: Count perft jobs for the coordinator listening on [socket]\n",
 	       progname);
 }
@@ -14,66 +14,499 @@
  * You should have received a copy of the GNU Affero General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  * */
-
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
 
+#include <sock.h>
 #include <util.h>
 
+#include <client/sock.h>
+#include <client/batch.h>
 #include <client/perft.h>
 #include <client/chess.h>
 
-static int run_sequence(struct game *game, char *sequence);
-static void calculate_perft(struct game *game, int curr_depth, int max_depth, unsigned long long *results,
-		int r_pi, int c_pi, int r_pf, int c_pf, bool autotest);
-static void add_node(struct game *game, int curr_depth, int max_depth, unsigned long long *results,
-		int r_i, int c_i, int r_f, int c_f, enum piece_type promotion, bool autotest);
-static void print_move(int ri, int ci, int rf, int cf, unsigned long long diff);
+/* Perft can reach the same position through different move orders, so the
+ * node counts of whole subtrees are cached by position and depth. The table
+ * is split into buckets of four entries that fill one cache line. When a
+ * bucket is full the shallowest entry gets replaced, since it's the cheapest
+ * one to count again.
+ *
+ * Every thread shares the same table without any locks. Each entry's key is
+ * stored xored with its data, so an entry that's torn by two threads writing
+ * it at once just doesn't match anything. */
+struct perft_entry {
+	_Atomic uint64_t key; /* the hash xored with `data` */
+	/* the node count is shifted left by 8, the bottom byte is the depth.
+	 * an empty entry is all zeroes, depth 0 is never stored. */
+	_Atomic uint64_t data;
+};
+
+#define BUCKET_SIZE 4
+
+struct perft_bucket {
+	struct perft_entry entries[BUCKET_SIZE];
+};
+
+struct perft_table {
+	struct perft_bucket *buckets;
+	uint64_t mask;
+};
+
+/* every thread keeps its own, they're added up at the end */
+struct perft_stats {
+	unsigned long long probes, hits, stores, replaced;
+};
+
+/* what the nodes at one ply are made up of, the same breakdown that published
+ * perft tables give. a node counts as a capture, castle and so on if the move
+ * leading to it is one. a single check is discovered if it's given by
+ * something other than the piece that moved (or the rook, when castling),
+ * double checks are only counted as double checks. */
+struct perft_counts {
+	unsigned long long captures, pessants, castles, promotions;
+	unsigned long long checks, discovered, double_checks, mates;
+};
+
+/* The tree is cut into tasks a few plies below the root, enough of them that
+ * every thread gets a bunch. Each task is the path of moves from the root to
+ * a position that gets counted by a single thread. */
+#define SPLIT_PLIES 4
+#define TASKS_PER_THREAD 16
+
+struct perft_task {
+	struct move path[SPLIT_PLIES];
+	int len;
+	int root; /* the index of the root move that it's under */
+	unsigned long long nodes;
+};
+
+/* Each thread starts out owning a range of tasks, working from the back. A
+ * thread that runs out takes tasks off of the front of somebody else's range,
+ * which is where the biggest chunks of work are left. */
+struct perft_deque {
+	pthread_mutex_t lock;
+	int top, bottom; /* the tasks left are [top, bottom) */
+};
 
-int run_perft(int level, char *start_pos, char *start_sequence, bool autotest) {
+/* A checkpoint is everything needed to pick a long perft test back up: the
+ * test itself, the node counts of the plies that are done, and the leaves under
+ * every root move that's done in the ply being counted now. It's written out
+ * to a temporary file that then gets renamed over the old checkpoint, so a
+ * crash can't leave half of one behind. */
+#define CHECKPOINT_SECONDS 10
+
+struct perft_checkpoint {
+	const char *path;
+	const struct perft_options *options;
+	/* the number of plies that are done, and their node counts */
+	int plies;
 	unsigned long long *results;
+	/* the root moves that are done in ply number `plies` */
+	int done;
+	char moves[MAX_MOVES][MOVE_STRING_LEN];
+	unsigned long long nodes[MAX_MOVES];
+	time_t saved;
+	/* the copies that `load_checkpoint` makes of the position and the
+	 * sequence, which the options point to until the test is over */
+	char *start_pos, *start_sequence;
+};
+
+/* A distributed test is cut up the same way that the threads split it, just
+ * into more pieces so that there's enough to go around a bunch of workers.
+ * Every job is sent as a line with the number of plies to count and the FEN to
+ * count them from, and the worker answers with a line holding the node count
+ * at every one of those plies. If a worker hangs up, whatever it was counting
+ * goes to somebody else. */
+#define DISTRIBUTED_JOBS 256
+#define MAX_JOB_PLIES 64
+#define REPLY_MAX 2048
+
+struct perft_remote {
+	int fd;
+	int job; /* the task that it's counting, or -1 */
+	/* the part of the reply that's come in so far */
+	size_t len;
+	char reply[REPLY_MAX];
+};
+
+struct perft_pool {
+	const struct game *root;
+	struct perft_task *tasks;
+	int depth; /* the number of plies below the root that get counted */
+	struct perft_table *table;
+	int threads;
+	struct perft_deque *deques;
+
+	/* the moves out of the root and the nodes counted under each of them.
+	 * `remaining` is the number of tasks left under each one. these are
+	 * only touched with `lock` held. */
+	const struct move_list *roots;
+	unsigned long long *root_nodes;
+	int *remaining;
+	pthread_mutex_t lock;
+	struct perft_checkpoint *checkpoint;
+};
+
+struct perft_worker {
+	struct perft_pool *pool;
+	int id;
 	struct game *game;
+	struct perft_stats stats;
+	/* nodes counted at every ply, or NULL */
+	unsigned long long *results;
+	/* the breakdown at every ply, or NULL if it isn't wanted */
+	struct perft_counts *counts;
+	pthread_t thread;
+};
+
+/* returns a table that takes up at most `mb` megabytes, or NULL on failure */
+static struct perft_table *new_perft_table(int mb);
+static void free_perft_table(struct perft_table *table);
+
+/* returns the number of nodes `depth` plies below the position with the hash
+ * `hash`, or -1 if it isn't in the table */
+static long long probe_table(struct perft_table *table, struct perft_stats *stats,
+		uint64_t hash, int depth);
+static void store_table(struct perft_table *table, struct perft_stats *stats,
+		uint64_t hash, int depth, unsigned long long nodes);
+
+static int run_sequence(struct game *game, char *sequence);
+
+/* returns the number of nodes `depth` plies below `game`. if `results` isn't
+ * NULL the nodes at every ply are counted into it, which only works without a
+ * table. */
+static unsigned long long count_nodes(struct game *game, int depth, struct perft_table *table,
+		struct perft_stats *stats, unsigned long long *results);
+
+/* like `count_nodes` without a table, but every ply is also broken down into
+ * `counts`. `last` is the move that led to `game`, or NULL at the root. this
+ * can't count leaves in bulk, since every leaf move has to be looked at. */
+static unsigned long long count_detailed(struct game *game, int depth,
+		const struct move *last, unsigned long long *results,
+		struct perft_counts *counts);
+
+/* counts the kind of move that `move` is, `game` is the position it's played
+ * from */
+static void tally_move(const struct game *game, const struct move *move,
+		struct perft_counts *counts);
+
+/* counts the checks and mates in `game`, which `last` was just played in.
+ * `checkers` comes from `get_checkers`, and `can_move` only matters if it
+ * isn't 0. */
+static void tally_position(const struct game *game, const struct move *last,
+		uint64_t checkers, bool can_move, struct perft_counts *counts);
+
+/* counts the nodes `depth` plies below `game` on `threads` threads and
+ * returns how many there are. `results` works like it does for
+ * `count_nodes`. if `counts` isn't NULL it's filled in like `count_detailed`
+ * does, which needs `results` and no table. if `divide` is set, the count
+ * under every root move is printed the way that perftree wants it, and `depth`
+ * is counted from the children of the root. if `checkpoint` isn't NULL, the
+ * root moves it has are skipped and the ones that get finished are added to
+ * it. returns -1 if something couldn't be allocated. */
+static long long count_parallel(struct game *game, int depth, bool divide,
+		struct perft_table *table, int threads, struct perft_stats *stats,
+		unsigned long long *results, struct perft_counts *counts,
+		struct perft_checkpoint *checkpoint);
+
+/* cuts the tree below `game` into tasks, see `struct perft_task`. the nodes
+ * above the tasks are counted into `results` and `counts` if they aren't
+ * NULL. returns the number of tasks, or -1 on failure. */
+static int split_tasks(struct game *game, int depth, bool divide, int want,
+		struct perft_task **tasks, unsigned long long *results,
+		struct perft_counts *counts);
+
+/* plays and takes back the moves leading to `task` */
+static void enter_task(struct game *game, const struct perft_task *task, struct undo *undo);
+static void leave_task(struct game *game, const struct perft_task *task, struct undo *undo);
+
+/* the body of every thread */
+static void *run_worker(void *arg);
+
+/* returns the index of the next task for `worker`, or -1 once every task has
+ * been taken */
+static int next_task(struct perft_worker *worker);
+
+/* adds up a task that's been counted, and checkpoints its root move if that
+ * was the last task under it */
+static void finish_task(struct perft_pool *pool, const struct perft_task *task);
+
+/* reads the test and the progress saved in `checkpoint->path`, and sets up
+ * `options` to run that test. returns 0 on success, or -1 on failure. */
+static int load_checkpoint(struct perft_checkpoint *checkpoint, struct perft_options *options);
+
+/* returns 0 on success, or -1 on failure. a checkpoint that couldn't be saved
+ * isn't fatal, the old one is still there. */
+static int save_checkpoint(struct perft_checkpoint *checkpoint);
+
+/* counts the nodes at every ply down to `depth` below `game` into `results`,
+ * and returns how many there are at `depth`, or -1 on failure */
+static long long count_plies(struct game *game, int depth, struct perft_table *table,
+		int threads, struct perft_stats *stats, unsigned long long *results);
+
+/* like `count_plies`, but the counting is done by workers that connect to
+ * `path` */
+static long long coordinate(struct game *game, int depth, char *path,
+		unsigned long long *results);
+
+/* sends the job for `task` to `remote`. returns 0 on success, or -1 if the
+ * worker is gone. */
+static int send_job(struct game *game, int depth, const struct perft_task *task,
+		struct perft_remote *remote);
+
+/* reads whatever `remote` has sent about `task` and adds it into `results`
+ * once it's all there. returns 1 if the job is done, 0 if it isn't yet, or -1
+ * if the worker is gone or isn't making any sense. */
+static int read_reply(struct perft_remote *remote, const struct perft_task *task,
+		int depth, unsigned long long *results);
+
+/* puts `remote`'s job back in line and closes it */
+static void lose_remote(struct perft_remote *remote, int *queue, int count, int head,
+		int *waiting);
+
+/* counts jobs from the coordinator on `options->worker` until it hangs up */
+static int serve_jobs(struct perft_options *options);
+
+static int send_all(int fd, const char *buff, size_t len);
+
+static void print_move(struct move *move, unsigned long long diff);
+
+static void print_counts(enum perft_format format, int level,
+		const unsigned long long *results, const struct perft_counts *counts);
 
+int run_perft(struct perft_options *options) {
+	int level, ret = 1;
+	unsigned long long *results;
+	struct game *game = NULL;
+	struct perft_table *table = NULL;
+	struct perft_stats stats = { 0, 0, 0, 0 };
+	struct perft_counts *counts = NULL;
+	struct perft_checkpoint *checkpoint = NULL;
+	long long total = 0;
+
+	if (options->worker != NULL) {
+		return serve_jobs(options);
+	}
+
+	if (options->coordinator != NULL &&
+	    (options->autotest || options->format != PERFT_PLAIN || options->checkpoint != NULL)) {
+		fputs("A distributed perft test can't be used with -a, -x, -C or -R\n", stderr);
+		return 1;
+	}
+
+	if (options->format != PERFT_PLAIN && (options->autotest || options->table_mb > 0)) {
+		fputs("The perft breakdown can't be used with -a or -H\n", stderr);
+		return 1;
+	}
+
+	if (options->checkpoint != NULL) {
+		if (options->autotest || options->format != PERFT_PLAIN) {
+			fputs("Checkpoints can't be used with -a or -x\n", stderr);
+			return 1;
+		}
+		if ((checkpoint = calloc(1, sizeof *checkpoint)) == NULL) {
+			fputs("Failed to initialize variables\n", stderr);
+			return 1;
+		}
+		checkpoint->path = options->checkpoint;
+		checkpoint->options = options;
+		if (options->resume && load_checkpoint(checkpoint, options) < 0) {
+			goto end;
+		}
+	}
+
+	level = options->level;
 	results = alloca(level * sizeof *results);
 	memset(results, 0, level * sizeof *results);
+	if (checkpoint != NULL) {
+		if (checkpoint->plies > 0) {
+			memcpy(results, checkpoint->results, checkpoint->plies * sizeof *results);
+		}
+		free(checkpoint->results);
+		checkpoint->results = results;
+	}
 	game = new_game();
 
-	if (start_pos != NULL) {
-		if (init_game(game, start_pos)) {
+	if (game == NULL) {
+		fputs("Failed to initialize variables\n", stderr);
+		goto end;
+	}
+
+	if (options->start_pos != NULL) {
+		if (init_game(game, options->start_pos)) {
 			fputs("Failed to initialize game\n", stderr);
-			return 1;
+			goto end;
 		}
 	}
 
-	if (start_sequence != NULL) {
-		int code;
-		code = run_sequence(game, start_sequence);
+	if (options->start_sequence != NULL) {
+		int code = run_sequence(game, options->start_sequence);
 		if (code != 0) {
-			return code;
+			ret = code;
+			goto end;
 		}
 	}
 
-	if (game == NULL || results == NULL) {
-		fputs("Failed to initialize variables\n", stderr);
-		return 1;
+	if (options->table_mb > 0 && (table = new_perft_table(options->table_mb)) == NULL) {
+		fputs("Failed to allocate the hash table\n", stderr);
+		goto end;
 	}
 
-	calculate_perft(game, 0, level, results, 0, 0, 0, 0, autotest);
+	if (options->format != PERFT_PLAIN) {
+		counts = alloca(level * sizeof *counts);
+		memset(counts, 0, level * sizeof *counts);
+	}
 
-	free_game(game);
+	if (options->autotest) {
+		total = 1;
+		if (level >= 2) {
+			total = count_parallel(game, level - 2, true, table, options->threads,
+					&stats, NULL, NULL, NULL);
+		}
+	}
+	else if (options->coordinator != NULL) {
+		total = coordinate(game, level - 1, options->coordinator, results);
+	}
+	else if (counts != NULL) {
+		total = count_parallel(game, level - 1, false, NULL, options->threads,
+				&stats, results, counts, NULL);
+	}
+	else if (checkpoint == NULL) {
+		total = count_plies(game, level - 1, table, options->threads, &stats, results);
+	}
+	else {
+		/* a checkpoint only keeps the leaves under each root move, so
+		 * every ply gets counted on its own. the shallow ones barely cost
+		 * anything. */
+		for (int i = checkpoint->plies; i < level && total >= 0; ++i) {
+			total = count_parallel(game, i, false, table, options->threads,
+					&stats, NULL, NULL, checkpoint);
+			results[i] = total;
+			if (total >= 0) {
+				checkpoint->plies = i + 1;
+				checkpoint->done = 0;
+				save_checkpoint(checkpoint);
+			}
+		}
+	}
+
+	if (total < 0) {
+		fputs("Failed to initialize variables\n", stderr);
+		goto end;
+	}
 
-	if (!autotest) {
+	if (options->autotest) {
+		putchar('\n');
+		printf("%lld\n", total);
+	}
+	else if (counts != NULL) {
+		print_counts(options->format, level, results, counts);
+	}
+	else {
 		for (int i = 0; i < level; ++i) {
 			printf("%llu\n", results[i]);
 		}
 	}
-	else {
-		putchar('\n');
-		printf("%llu\n", results[level-1]);
+
+	if (table != NULL) {
+		fprintf(stderr, "hash table: %llu probes, %llu hits (%.1f%%), %llu stores, %llu replaced\n",
+				stats.probes, stats.hits,
+				stats.probes ? 100.0 * stats.hits / stats.probes : 0.0,
+				stats.stores, stats.replaced);
+	}
+	ret = 0;
+end:
+	if (table != NULL) {
+		free_perft_table(table);
+	}
+	if (checkpoint != NULL) {
+		free(checkpoint->start_pos);
+		free(checkpoint->start_sequence);
+		free(checkpoint);
 	}
+	if (game != NULL) {
+		free_game(game);
+	}
+	return ret;
+}
 
-	return 0;
+static struct perft_table *new_perft_table(int mb) {
+	struct perft_table *ret;
+	uint64_t buckets = 1;
+
+	/* the mask only works with a power of two */
+	while (buckets * 2 * sizeof (struct perft_bucket) <= (uint64_t) mb << 20) {
+		buckets *= 2;
+	}
+
+	if ((ret = malloc(sizeof *ret)) == NULL) {
+		return NULL;
+	}
+	if ((ret->buckets = aligned_alloc(64, buckets * sizeof *ret->buckets)) == NULL) {
+		free(ret);
+		return NULL;
+	}
+	memset(ret->buckets, 0, buckets * sizeof *ret->buckets);
+	ret->mask = buckets - 1;
+	return ret;
+}
+
+static void free_perft_table(struct perft_table *table) {
+	free(table->buckets);
+	free(table);
+}
+
+static long long probe_table(struct perft_table *table, struct perft_stats *stats,
+		uint64_t hash, int depth) {
+	struct perft_entry *entries = table->buckets[hash & table->mask].entries;
+
+	++stats->probes;
+	for (int i = 0; i < BUCKET_SIZE; ++i) {
+		uint64_t key = atomic_load_explicit(&entries[i].key, memory_order_relaxed);
+		uint64_t data = atomic_load_explicit(&entries[i].data, memory_order_relaxed);
+		if ((key ^ data) == hash && (int) (data & 0xff) == depth) {
+			++stats->hits;
+			return data >> 8;
+		}
+	}
+	return -1;
+}
+
+static void store_table(struct perft_table *table, struct perft_stats *stats,
+		uint64_t hash, int depth, unsigned long long nodes) {
+	struct perft_entry *entries = table->buckets[hash & table->mask].entries;
+	struct perft_entry *victim = NULL;
+	uint64_t victim_data = 0, data;
+
+	for (int i = 0; i < BUCKET_SIZE; ++i) {
+		data = atomic_load_explicit(&entries[i].data, memory_order_relaxed);
+		if (data == 0) {
+			victim = &entries[i];
+			victim_data = 0;
+			break;
+		}
+		if (victim == NULL || (data & 0xff) < (victim_data & 0xff)) {
+			victim = &entries[i];
+			victim_data = data;
+		}
+	}
+
+	++stats->stores;
+	if (victim_data != 0) {
+		++stats->replaced;
+	}
+	data = nodes << 8 | depth;
+	atomic_store_explicit(&victim->key, hash ^ data, memory_order_relaxed);
+	atomic_store_explicit(&victim->data, data, memory_order_relaxed);
 }
 
 static int run_sequence(struct game *game, char *sequence) {
@@ -84,7 +517,11 @@ static int run_sequence(struct game *game, char *sequence) {
 			buff[j] = sequence[i+j];
 		}
 		buff[j] = '\0';
-		if (parse_move(game, buff) < 0) {
+		/* a game that's over is still a fine position to count from, only
+		 * moves that weren't played are a problem */
+		switch (parse_move(game, buff)) {
+		case NONFATAL_ERROR:
+			fprintf(stderr, "Illegal move in the starting sequence: %s\n", buff);
 			return 1;
 		}
 		i += j;
@@ -95,82 +532,848 @@ static int run_sequence(struct game *game, char *sequence) {
 	return 0;
 }
 
-static void calculate_perft(struct game *game, int curr_depth, int max_depth, unsigned long long *results,
-		int r_pi, int c_pi, int r_pf, int c_pf, bool autotest) {
-	unsigned long long old_depth;
+static unsigned long long count_nodes(struct game *game, int depth, struct perft_table *table,
+		struct perft_stats *stats, unsigned long long *results) {
+	struct move_list list;
+	unsigned long long ret;
+	long long cached;
+
+	if (results != NULL) {
+		++results[0];
+	}
+	if (depth <= 0) {
+		return 1;
+	}
+
+	/* the last ply is counted in bulk by `count_positions`, and so is a whole
+	 * subtree when there's no table to probe and no plies to break it into */
+	if (depth == 1 || (table == NULL && results == NULL)) {
+		ret = count_positions(game, depth);
+		if (results != NULL) {
+			results[1] += ret;
+		}
+		return ret;
+	}
+
+	if (table != NULL && (cached = probe_table(table, stats, game_hash(game), depth)) >= 0) {
+		return cached;
+	}
+
+	ret = 0;
+	generate_legal_moves(game, &list);
+	for (int i = 0; i < list.len; ++i) {
+		struct undo undo;
+		do_move(game, &list.moves[i], &undo);
+		ret += count_nodes(game, depth - 1, table, stats, results ? results + 1 : NULL);
+		undo_move(game, &undo);
+	}
+
+	if (table != NULL) {
+		store_table(table, stats, game_hash(game), depth, ret);
+	}
+	return ret;
+}
+
+static unsigned long long count_detailed(struct game *game, int depth,
+		const struct move *last, unsigned long long *results,
+		struct perft_counts *counts) {
+	struct move_list list;
+	unsigned long long ret;
+	uint64_t checkers;
+
+	++results[0];
+	checkers = get_checkers(game);
+	if (depth <= 0) {
+		/* a leaf only needs its moves to tell if it's mate */
+		if (checkers != 0) {
+			tally_position(game, last, checkers,
+					generate_legal_moves(game, &list) > 0, counts);
+		}
+		return 1;
+	}
+
+	generate_legal_moves(game, &list);
+	tally_position(game, last, checkers, list.len > 0, counts);
+
+	ret = 0;
+	for (int i = 0; i < list.len; ++i) {
+		struct undo undo;
+		tally_move(game, &list.moves[i], counts + 1);
+		do_move(game, &list.moves[i], &undo);
+		ret += count_detailed(game, depth - 1, &list.moves[i], results + 1, counts + 1);
+		undo_move(game, &undo);
+	}
+	return ret;
+}
 
-	if (curr_depth >= max_depth) {
+static void tally_move(const struct game *game, const struct move *move,
+		struct perft_counts *counts) {
+	int from = move_from(move), to = move_to(move);
+	struct piece moving = get_piece(game, from / 8, from % 8);
+	struct piece taken = get_piece(game, to / 8, to % 8);
+
+	if (taken.type != EMPTY) {
+		++counts->captures;
+	}
+	else if (moving.type == PAWN && from % 8 != to % 8) {
+		++counts->captures;
+		++counts->pessants;
+	}
+	if (moving.type == KING && (from - to == 2 || to - from == 2)) {
+		++counts->castles;
+	}
+	if (move_promotion(move) != EMPTY) {
+		++counts->promotions;
+	}
+}
+
+static void tally_position(const struct game *game, const struct move *last,
+		uint64_t checkers, bool can_move, struct perft_counts *counts) {
+	int from, to;
+	uint64_t moved;
+
+	if (checkers == 0 || last == NULL) {
 		return;
 	}
+	from = move_from(last);
+	to = move_to(last);
+	moved = UINT64_C(1) << to;
+	if (get_piece(game, to / 8, to % 8).type == KING && (from - to == 2 || to - from == 2)) {
+		/* the rook ends up on the square that the king passed over */
+		moved |= UINT64_C(1) << (from + to) / 2;
+	}
+
+	++counts->checks;
+	if (checkers & (checkers - 1)) {
+		++counts->double_checks;
+	}
+	else if (checkers & ~moved) {
+		++counts->discovered;
+	}
+	if (!can_move) {
+		++counts->mates;
+	}
+}
 
-	old_depth = 0;
+static long long count_parallel(struct game *game, int depth, bool divide,
+		struct perft_table *table, int threads, struct perft_stats *stats,
+		unsigned long long *results, struct perft_counts *counts,
+		struct perft_checkpoint *checkpoint) {
+	struct perft_pool pool;
+	struct perft_worker *workers;
+	struct move_list roots;
+	unsigned long long *root_nodes;
+	long long ret = -1;
+	int count, kept, started, ready = 0;
 
-	if (autotest && curr_depth == 1) {
-		old_depth = results[max_depth - 1];
+	if (threads < 1) {
+		threads = 1;
+	}
+	if ((count = split_tasks(game, depth, divide, threads * TASKS_PER_THREAD,
+					&pool.tasks, results, counts)) < 0) {
+		return -1;
 	}
+	pool.root = game;
+	pool.depth = divide ? depth + 1 : depth;
+	pool.table = table;
+	pool.threads = threads;
+	pool.roots = &roots;
+	pool.checkpoint = checkpoint;
+	pthread_mutex_init(&pool.lock, NULL);
 
-	++results[curr_depth];
+	workers = calloc(threads, sizeof *workers);
+	pool.deques = calloc(threads, sizeof *pool.deques);
+	generate_legal_moves(game, &roots);
+	pool.root_nodes = root_nodes = calloc(roots.len + 1, sizeof *root_nodes);
+	pool.remaining = calloc(roots.len + 1, sizeof *pool.remaining);
+	if (workers == NULL || pool.deques == NULL || root_nodes == NULL ||
+	    pool.remaining == NULL) {
+		goto end;
+	}
 
-	/* This code is intentionally very inefficient, it's designed to weed
-	 * out bugs in my engine, not to efficiently calculate perft values. I
-	 * could do a lot of pruning, but that would be testing the test
-	 * function, and not the real function. */
-	for (int r_i = 0; r_i < 8; r_i++) {
-		for (int c_i = 0; c_i < 8; c_i++) {
-			for (int r_f = 0; r_f < 8; ++r_f) {
-				for (int c_f = 0; c_f < 8; ++c_f) {
-					add_node(game, curr_depth, max_depth, results, r_i, c_i, r_f, c_f, EMPTY, autotest);
+	/* the root moves that were done when the checkpoint was saved don't
+	 * get counted again */
+	for (int i = 0; checkpoint != NULL && i < roots.len; ++i) {
+		char move[MOVE_STRING_LEN];
+		move_to_string(&roots.moves[i], move);
+		for (int j = 0; j < checkpoint->done; ++j) {
+			if (strcmp(move, checkpoint->moves[j]) == 0) {
+				root_nodes[i] = checkpoint->nodes[j];
+				pool.remaining[i] = -1;
+			}
+		}
+	}
+	kept = 0;
+	for (int i = 0; i < count; ++i) {
+		if (pool.tasks[i].len > 0 && pool.remaining[pool.tasks[i].root] < 0) {
+			continue;
+		}
+		++pool.remaining[pool.tasks[i].root];
+		pool.tasks[kept++] = pool.tasks[i];
+	}
+	count = kept;
+
+	for (int i = 0; i < threads; ++i) {
+		pthread_mutex_init(&pool.deques[i].lock, NULL);
+		ready = i + 1;
+		pool.deques[i].top = (long long) count * i / threads;
+		pool.deques[i].bottom = (long long) count * (i + 1) / threads;
+		workers[i].pool = &pool;
+		workers[i].id = i;
+		if ((workers[i].game = new_game()) == NULL) {
+			goto free_workers;
+		}
+		copy_game(workers[i].game, game);
+		if (results != NULL &&
+		    (workers[i].results = calloc(pool.depth + 1, sizeof *results)) == NULL) {
+			goto free_workers;
+		}
+		if (counts != NULL &&
+		    (workers[i].counts = calloc(pool.depth + 1, sizeof *counts)) == NULL) {
+			goto free_workers;
+		}
+	}
+
+	/* the calling thread does its share too */
+	for (started = 1; started < threads; ++started) {
+		if (pthread_create(&workers[started].thread, NULL, run_worker, &workers[started])) {
+			break;
+		}
+	}
+	run_worker(&workers[0]);
+	for (int i = 1; i < started; ++i) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	ret = 0;
+	for (int i = 0; i <= roots.len; ++i) {
+		ret += root_nodes[i];
+	}
+	for (int i = 0; i < threads; ++i) {
+		stats->probes += workers[i].stats.probes;
+		stats->hits += workers[i].stats.hits;
+		stats->stores += workers[i].stats.stores;
+		stats->replaced += workers[i].stats.replaced;
+		for (int j = 0; results != NULL && j <= pool.depth; ++j) {
+			results[j] += workers[i].results[j];
+		}
+		for (int j = 0; counts != NULL && j <= pool.depth; ++j) {
+			const struct perft_counts *add = &workers[i].counts[j];
+			counts[j].captures += add->captures;
+			counts[j].pessants += add->pessants;
+			counts[j].castles += add->castles;
+			counts[j].promotions += add->promotions;
+			counts[j].checks += add->checks;
+			counts[j].discovered += add->discovered;
+			counts[j].double_checks += add->double_checks;
+			counts[j].mates += add->mates;
+		}
+	}
+	if (divide) {
+		for (int i = 0; i < roots.len; ++i) {
+			print_move(&roots.moves[i], root_nodes[i]);
+		}
+	}
+
+free_workers:
+	for (int i = 0; i < threads; ++i) {
+		if (workers[i].game != NULL) {
+			free_game(workers[i].game);
+		}
+		free(workers[i].results);
+		free(workers[i].counts);
+	}
+	/* a worker that failed to set up stops the deques after it from ever
+	 * getting a lock */
+	for (int i = 0; i < ready; ++i) {
+		pthread_mutex_destroy(&pool.deques[i].lock);
+	}
+end:
+	pthread_mutex_destroy(&pool.lock);
+	free(pool.remaining);
+	free(root_nodes);
+	free(pool.deques);
+	free(workers);
+	free(pool.tasks);
+	return ret;
+}
+
+static int split_tasks(struct game *game, int depth, bool divide, int want,
+		struct perft_task **tasks, unsigned long long *results,
+		struct perft_counts *counts) {
+	struct perft_task *curr, *next;
+	struct move_list list;
+	struct undo undo[SPLIT_PLIES];
+	int count, next_count, capacity, ply;
+
+	if ((curr = malloc(sizeof *curr)) == NULL) {
+		return -1;
+	}
+	curr->len = curr->root = 0;
+	curr->nodes = 0;
+	count = 1;
+
+	/* in divide mode the root itself is never counted, its moves are */
+	if (divide) {
+		++depth;
+		want = want > 1 ? want : 2;
+	}
+
+	for (ply = 0; ply < depth && ply < SPLIT_PLIES && (count < want || (divide && ply == 0)); ++ply) {
+		next = NULL;
+		next_count = capacity = 0;
+		for (int i = 0; i < count; ++i) {
+			enter_task(game, &curr[i], undo);
+			generate_legal_moves(game, &list);
+			if (counts != NULL) {
+				tally_position(game, curr[i].len ? &curr[i].path[curr[i].len - 1] : NULL,
+						get_checkers(game), list.len > 0, &counts[ply]);
+				for (int j = 0; j < list.len; ++j) {
+					tally_move(game, &list.moves[j], &counts[ply + 1]);
+				}
+			}
+			leave_task(game, &curr[i], undo);
+			if (next_count + list.len > capacity) {
+				struct perft_task *grown;
+				capacity = (next_count + list.len) * 2;
+				if ((grown = realloc(next, capacity * sizeof *next)) == NULL) {
+					free(next);
+					free(curr);
+					return -1;
+				}
+				next = grown;
+			}
+			for (int j = 0; j < list.len; ++j) {
+				struct perft_task *task = &next[next_count++];
+				*task = curr[i];
+				task->path[task->len++] = list.moves[j];
+				if (ply == 0) {
+					task->root = j;
 				}
 			}
 		}
+		if (results != NULL) {
+			results[ply] += count;
+		}
+		free(curr);
+		curr = next;
+		count = next_count;
+	}
+
+	*tasks = curr;
+	return count;
+}
+
+static void enter_task(struct game *game, const struct perft_task *task, struct undo *undo) {
+	for (int i = 0; i < task->len; ++i) {
+		do_move(game, &task->path[i], &undo[i]);
 	}
+}
+
+static void leave_task(struct game *game, const struct perft_task *task, struct undo *undo) {
+	for (int i = task->len - 1; i >= 0; --i) {
+		undo_move(game, &undo[i]);
+	}
+}
+
+static void *run_worker(void *arg) {
+	struct perft_worker *worker = (struct perft_worker *) arg;
+	struct perft_pool *pool = worker->pool;
+	struct undo undo[SPLIT_PLIES];
+	int i;
 
-	if (autotest && curr_depth == 1) {
-		unsigned long long diff;
-		diff = results[max_depth - 1] - old_depth;
-		if (diff == 0) {
-			return;
+	while ((i = next_task(worker)) >= 0) {
+		struct perft_task *task = &pool->tasks[i];
+		enter_task(worker->game, task, undo);
+		if (worker->counts != NULL) {
+			task->nodes = count_detailed(worker->game, pool->depth - task->len,
+					task->len ? &task->path[task->len - 1] : NULL,
+					worker->results + task->len, worker->counts + task->len);
 		}
-		print_move(r_pi, c_pi, r_pf, c_pf, diff);
+		else {
+			task->nodes = count_nodes(worker->game, pool->depth - task->len, pool->table,
+					&worker->stats, worker->results ? worker->results + task->len : NULL);
+		}
+		leave_task(worker->game, task, undo);
+		finish_task(pool, task);
 	}
+	return NULL;
 }
-static void add_node(struct game *game, int curr_depth, int max_depth, unsigned long long *results,
-		int r_i, int c_i, int r_f, int c_f, enum piece_type promotion, bool autotest) {
-	struct move move;
-	struct game backup;
-	int code;
 
-	memcpy(&backup, game, sizeof backup);
+static int next_task(struct perft_worker *worker) {
+	struct perft_pool *pool = worker->pool;
+	struct perft_deque *deque = &pool->deques[worker->id];
+	int ret = -1;
 
-	move.r_i = r_i;
-	move.c_i = c_i;
-	move.r_f = r_f;
-	move.c_f = c_f;
-	move.promotion = promotion;
+	pthread_mutex_lock(&deque->lock);
+	if (deque->top < deque->bottom) {
+		ret = --deque->bottom;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	if (ret >= 0) {
+		return ret;
+	}
+
+	/* nothing left here, go steal something */
+	for (int i = 1; i < pool->threads && ret < 0; ++i) {
+		deque = &pool->deques[(worker->id + i) % pool->threads];
+		pthread_mutex_lock(&deque->lock);
+		if (deque->top < deque->bottom) {
+			ret = deque->top++;
+		}
+		pthread_mutex_unlock(&deque->lock);
+	}
+	return ret;
+}
 
-	code = make_move(&backup, &move);
+static void finish_task(struct perft_pool *pool, const struct perft_task *task) {
+	struct perft_checkpoint *checkpoint = pool->checkpoint;
 
-	switch (code) {
-	case ILLEGAL_MOVE:
-		return;
-	case BLACK_WIN: case WHITE_WIN: case FORCED_DRAW:
-		++results[curr_depth+1];
-		return;
-	case MISSING_PROMOTION:
-		if (promotion != EMPTY) {
-			fputs("ENGINE ERROR!!! make_move() returned MISSING_PROMOTION on non-empty promotion type\n", stderr);
-			exit(EXIT_FAILURE);
+	pthread_mutex_lock(&pool->lock);
+	pool->root_nodes[task->root] += task->nodes;
+	if (--pool->remaining[task->root] == 0 && checkpoint != NULL && task->len > 0) {
+		move_to_string(&pool->roots->moves[task->root], checkpoint->moves[checkpoint->done]);
+		checkpoint->nodes[checkpoint->done++] = pool->root_nodes[task->root];
+		if (time(NULL) - checkpoint->saved >= CHECKPOINT_SECONDS) {
+			save_checkpoint(checkpoint);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static int load_checkpoint(struct perft_checkpoint *checkpoint, struct perft_options *options) {
+	FILE *file;
+	char *line = NULL;
+	size_t capacity = 0;
+	ssize_t len;
+	int ret = -1;
+
+	if ((file = fopen(checkpoint->path, "r")) == NULL) {
+		fprintf(stderr, "Failed to open %s\n", checkpoint->path);
+		return -1;
+	}
+
+	options->level = -1;
+	options->start_pos = options->start_sequence = NULL;
+	if (getline(&line, &capacity, file) < 0 || strcmp(line, "chessh perft checkpoint\n") != 0) {
+		goto bad;
+	}
+	while ((len = getline(&line, &capacity, file)) > 0) {
+		char move[MOVE_STRING_LEN];
+		unsigned long long nodes;
+		int ply;
+
+		if (line[len - 1] == '\n') {
+			line[--len] = '\0';
+		}
+
+		if (sscanf(line, "level %d", &ply) == 1 && options->level == -1 && ply > 0) {
+			options->level = ply;
+			if ((checkpoint->results = calloc(ply, sizeof *checkpoint->results)) == NULL) {
+				goto bad;
+			}
+		}
+		else if (strncmp(line, "position ", 9) == 0 && options->start_pos == NULL) {
+			if ((checkpoint->start_pos = strdup(line + 9)) == NULL) {
+				goto bad;
+			}
+			options->start_pos = checkpoint->start_pos;
+		}
+		else if (strncmp(line, "sequence ", 9) == 0 && options->start_sequence == NULL) {
+			if ((checkpoint->start_sequence = strdup(line + 9)) == NULL) {
+				goto bad;
+			}
+			options->start_sequence = checkpoint->start_sequence;
+		}
+		else if (sscanf(line, "ply %d %llu", &ply, &nodes) == 2 &&
+				options->level != -1 && ply == checkpoint->plies &&
+				ply < options->level && checkpoint->done == 0) {
+			checkpoint->results[checkpoint->plies++] = nodes;
+		}
+		else if (sscanf(line, "root %5s %llu", move, &nodes) == 2 &&
+				checkpoint->done < MAX_MOVES) {
+			strcpy(checkpoint->moves[checkpoint->done], move);
+			checkpoint->nodes[checkpoint->done++] = nodes;
+		}
+		else {
+			goto bad;
+		}
+	}
+	if (options->level == -1) {
+		goto bad;
+	}
+
+	fprintf(stderr, "Resuming at ply %d with %d root moves done\n",
+			checkpoint->plies, checkpoint->done);
+	checkpoint->saved = time(NULL);
+	ret = 0;
+	goto end;
+bad:
+	fprintf(stderr, "%s isn't a valid perft checkpoint\n", checkpoint->path);
+	free(checkpoint->results);
+	checkpoint->results = NULL;
+end:
+	free(line);
+	fclose(file);
+	return ret;
+}
+
+static int save_checkpoint(struct perft_checkpoint *checkpoint) {
+	const struct perft_options *options = checkpoint->options;
+	char tmp_path[4096];
+	FILE *file;
+	int ret = 0;
+
+	checkpoint->saved = time(NULL);
+	if (snprintf(tmp_path, sizeof tmp_path, "%s.tmp", checkpoint->path) >= (int) sizeof tmp_path ||
+	    (file = fopen(tmp_path, "w")) == NULL) {
+		fprintf(stderr, "Failed to save the perft checkpoint to %s\n", checkpoint->path);
+		return -1;
+	}
+
+	fputs("chessh perft checkpoint\n", file);
+	fprintf(file, "level %d\n", options->level);
+	if (options->start_pos != NULL) {
+		fprintf(file, "position %s\n", options->start_pos);
+	}
+	if (options->start_sequence != NULL) {
+		fprintf(file, "sequence %s\n", options->start_sequence);
+	}
+	for (int i = 0; i < checkpoint->plies; ++i) {
+		fprintf(file, "ply %d %llu\n", i, checkpoint->results[i]);
+	}
+	for (int i = 0; i < checkpoint->done; ++i) {
+		fprintf(file, "root %s %llu\n", checkpoint->moves[i], checkpoint->nodes[i]);
+	}
+
+	/* the new checkpoint has to be on the disk before it replaces the old
+	 * one */
+	if (fflush(file) != 0 || fsync(fileno(file)) != 0) {
+		ret = -1;
+	}
+	if (fclose(file) != 0 || ret < 0 || rename(tmp_path, checkpoint->path) != 0) {
+		fprintf(stderr, "Failed to save the perft checkpoint to %s\n", checkpoint->path);
+		remove(tmp_path);
+		return -1;
+	}
+	return 0;
+}
+
+static long long count_plies(struct game *game, int depth, struct perft_table *table,
+		int threads, struct perft_stats *stats, unsigned long long *results) {
+	long long total = 0;
+
+	if (table == NULL) {
+		return count_parallel(game, depth, false, NULL, threads, stats, results,
+				NULL, NULL);
+	}
+
+	/* a table hit skips over the plies in between, so every ply gets
+	 * counted on its own. the shallow ones fill up the table for the deeper
+	 * ones. */
+	for (int i = 0; i <= depth && total >= 0; ++i) {
+		total = count_parallel(game, i, false, table, threads, stats, NULL, NULL, NULL);
+		results[i] = total;
+	}
+	return total;
+}
+
+static long long coordinate(struct game *game, int depth, char *path,
+		unsigned long long *results) {
+	struct perft_task *tasks;
+	struct perft_remote *remotes;
+	struct pollfd *fds;
+	int *queue;
+	int listen_fd, count, remote_count = 0, capacity = 8;
+	int head = 0, waiting, done = 0;
+	long long ret = -1;
+
+	if (depth >= MAX_JOB_PLIES) {
+		fprintf(stderr, "A distributed perft test can be at most %d levels\n", MAX_JOB_PLIES);
+		return -1;
+	}
+	if ((count = split_tasks(game, depth, false, DISTRIBUTED_JOBS, &tasks, results, NULL)) < 0) {
+		return -1;
+	}
+	queue = malloc((count + 1) * sizeof *queue);
+	remotes = malloc(capacity * sizeof *remotes);
+	fds = malloc((capacity + 1) * sizeof *fds);
+	if (queue == NULL || remotes == NULL || fds == NULL ||
+	    (listen_fd = setup_unix_sock(path)) < 0) {
+		free(fds);
+		free(remotes);
+		free(queue);
+		free(tasks);
+		return -1;
+	}
+
+	/* the jobs that aren't being counted yet, in a circle starting at
+	 * `head` */
+	for (int i = 0; i < count; ++i) {
+		queue[i] = i;
+	}
+	waiting = count;
+	fprintf(stderr, "Handing out %d jobs to workers on %s\n", count, path);
+
+	while (done < count) {
+		int kept;
+
+		for (int i = 0; i < remote_count && waiting > 0; ++i) {
+			if (remotes[i].job != -1) {
+				continue;
+			}
+			remotes[i].job = queue[head];
+			head = (head + 1) % count;
+			--waiting;
+			if (send_job(game, depth, &tasks[remotes[i].job], &remotes[i]) < 0) {
+				lose_remote(&remotes[i], queue, count, head, &waiting);
+			}
+		}
+
+		fds[0].fd = listen_fd;
+		fds[0].events = POLLIN;
+		for (int i = 0; i < remote_count; ++i) {
+			fds[i + 1].fd = remotes[i].fd;
+			fds[i + 1].events = POLLIN;
+		}
+		if (poll(fds, remote_count + 1, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("poll() failed");
+			goto end;
+		}
+
+		for (int i = 0; i < remote_count; ++i) {
+			if (remotes[i].fd < 0 || fds[i + 1].revents == 0) {
+				continue;
+			}
+			switch (remotes[i].job == -1 ? -1 :
+					read_reply(&remotes[i], &tasks[remotes[i].job], depth, results)) {
+			case 1:
+				remotes[i].job = -1;
+				++done;
+				break;
+			case -1:
+				lose_remote(&remotes[i], queue, count, head, &waiting);
+				break;
+			}
+		}
+
+		kept = 0;
+		for (int i = 0; i < remote_count; ++i) {
+			if (remotes[i].fd >= 0) {
+				remotes[kept++] = remotes[i];
+			}
+		}
+		remote_count = kept;
+
+		if (fds[0].revents & POLLIN) {
+			int fd;
+			if ((fd = accept(listen_fd, NULL, NULL)) < 0) {
+				perror("accept() failed");
+				continue;
+			}
+			if (remote_count >= capacity) {
+				struct perft_remote *grown_remotes;
+				struct pollfd *grown_fds;
+				capacity *= 2;
+				grown_remotes = realloc(remotes, capacity * sizeof *remotes);
+				if (grown_remotes != NULL) {
+					remotes = grown_remotes;
+				}
+				grown_fds = realloc(fds, (capacity + 1) * sizeof *fds);
+				if (grown_fds != NULL) {
+					fds = grown_fds;
+				}
+				if (grown_remotes == NULL || grown_fds == NULL) {
+					close(fd);
+					goto end;
+				}
+			}
+			remotes[remote_count].fd = fd;
+			remotes[remote_count].job = -1;
+			remotes[remote_count].len = 0;
+			++remote_count;
+		}
+	}
+	ret = depth < 0 ? 0 : (long long) results[depth];
+
+end:
+	/* the workers quit once they're hung up on */
+	for (int i = 0; i < remote_count; ++i) {
+		close(remotes[i].fd);
+	}
+	close(listen_fd);
+	unlink(path);
+	free(fds);
+	free(remotes);
+	free(queue);
+	free(tasks);
+	return ret;
+}
+
+static int send_job(struct game *game, int depth, const struct perft_task *task,
+		struct perft_remote *remote) {
+	struct undo undo[SPLIT_PLIES];
+	char job[FEN_MAX_LEN + 8];
+	int len;
+
+	len = snprintf(job, sizeof job, "%d ", depth - task->len);
+	enter_task(game, task, undo);
+	game_to_fen(game, job + len);
+	leave_task(game, task, undo);
+	strcat(job, "\n");
+	return send_all(remote->fd, job, strlen(job));
+}
+
+static int read_reply(struct perft_remote *remote, const struct perft_task *task,
+		int depth, unsigned long long *results) {
+	unsigned long long nodes[MAX_JOB_PLIES];
+	ssize_t got;
+	char *s, *end;
+
+	got = read(remote->fd, remote->reply + remote->len, sizeof remote->reply - 1 - remote->len);
+	if (got < 0 && errno == EINTR) {
+		return 0;
+	}
+	if (got <= 0) {
+		return -1;
+	}
+	remote->len += got;
+	remote->reply[remote->len] = '\0';
+	if (memchr(remote->reply, '\n', remote->len) == NULL) {
+		return remote->len < sizeof remote->reply - 1 ? 0 : -1;
+	}
+
+	/* one count for every ply from the task down, and nothing after it */
+	s = remote->reply;
+	for (int i = task->len; i <= depth; ++i) {
+		nodes[i] = strtoull(s, &end, 10);
+		if (end == s || (*end != ' ' && *end != '\n')) {
+			return -1;
+		}
+		s = end + 1;
+	}
+	if (*end != '\n' || *s != '\0') {
+		return -1;
+	}
+
+	for (int i = task->len; i <= depth; ++i) {
+		results[i] += nodes[i];
+	}
+	remote->len = 0;
+	return 1;
+}
+
+static void lose_remote(struct perft_remote *remote, int *queue, int count, int head,
+		int *waiting) {
+	if (remote->job != -1) {
+		fputs("Lost a worker, its job goes to somebody else\n", stderr);
+		queue[(head + (*waiting)++) % count] = remote->job;
+	}
+	close(remote->fd);
+	remote->fd = -1;
+}
+
+static int serve_jobs(struct perft_options *options) {
+	unsigned long long results[MAX_JOB_PLIES];
+	char reply[REPLY_MAX];
+	struct perft_table *table = NULL;
+	struct perft_stats stats = { 0, 0, 0, 0 };
+	struct game *game;
+	char *line = NULL;
+	size_t capacity = 0;
+	FILE *in;
+	int fd, ret = 1;
+
+	if ((fd = unix_connect(options->worker)) < 0) {
+		return 1;
+	}
+	if ((in = fdopen(fd, "r")) == NULL || (game = new_game()) == NULL) {
+		fputs("Failed to initialize variables\n", stderr);
+		return 1;
+	}
+	if (options->table_mb > 0 && (table = new_perft_table(options->table_mb)) == NULL) {
+		fputs("Failed to allocate the hash table\n", stderr);
+		return 1;
+	}
+
+	while (getline(&line, &capacity, in) > 0) {
+		const char *next;
+		char *fen;
+		long depth = strtol(line, &fen, 10);
+		int len = 0;
+
+		if (fen == line || *fen != ' ' || depth < 0 || depth >= MAX_JOB_PLIES ||
+		    parse_fen(game, fen + 1, &next) < 0) {
+			fputs("Got a perft job that doesn't make sense\n", stderr);
+			goto end;
+		}
+
+		memset(results, 0, sizeof results);
+		if (count_plies(game, depth, table, options->threads, &stats, results) < 0) {
+			fputs("Failed to initialize variables\n", stderr);
+			goto end;
+		}
+		for (int i = 0; i <= depth; ++i) {
+			len += snprintf(reply + len, sizeof reply - len, i ? " %llu" : "%llu", results[i]);
+		}
+		reply[len++] = '\n';
+		if (send_all(fd, reply, len) < 0) {
+			goto end;
 		}
-		add_node(&backup, curr_depth, max_depth, results, r_i, c_i, r_f, c_f, ROOK, autotest);
-		add_node(&backup, curr_depth, max_depth, results, r_i, c_i, r_f, c_f, KNIGHT, autotest);
-		add_node(&backup, curr_depth, max_depth, results, r_i, c_i, r_f, c_f, BISHOP, autotest);
-		add_node(&backup, curr_depth, max_depth, results, r_i, c_i, r_f, c_f, QUEEN, autotest);
-		break;
-	default:
-		calculate_perft(&backup, curr_depth+1, max_depth, results, r_i, c_i, r_f, c_f, autotest);
 	}
+	ret = 0;
+
+end:
+	if (table != NULL) {
+		free_perft_table(table);
+	}
+	free_game(game);
+	free(line);
+	fclose(in);
+	return ret;
 }
 
-static void print_move(int ri, int ci, int rf, int cf, unsigned long long diff) {
-	printf("%c%d%c%d %llu\n", ci+'a', 8 - ri, cf+'a', 8 - rf, diff);
+static int send_all(int fd, const char *buff, size_t len) {
+	while (len > 0) {
+		ssize_t sent = send(fd, buff, len, MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		buff += sent;
+		len -= sent;
+	}
+	return 0;
+}
+
+static void print_move(struct move *move, unsigned long long diff) {
+	char str[MOVE_STRING_LEN];
+	printf("%s %llu\n", move_to_string(move, str), diff);
+}
+
+static void print_counts(enum perft_format format, int level,
+		const unsigned long long *results, const struct perft_counts *counts) {
+	if (format == PERFT_CSV) {
+		puts("depth,nodes,captures,en_passant,castles,promotions,"
+		     "checks,discovered_checks,double_checks,checkmates");
+	}
+	else {
+		printf("%5s %14s %12s %10s %10s %10s %12s %10s %10s %10s\n",
+				"depth", "nodes", "captures", "e.p.", "castles", "promotions",
+				"checks", "discovered", "double", "mates");
+	}
+
+	for (int i = 0; i < level; ++i) {
+		const struct perft_counts *c = &counts[i];
+		printf(format == PERFT_CSV ?
+				"%d,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n" :
+				"%5d %14llu %12llu %10llu %10llu %10llu %12llu %10llu %10llu %10llu\n",
+				i, results[i], c->captures, c->pessants, c->castles, c->promotions,
+				c->checks, c->discovered, c->double_checks, c->mates);
+	}
 }
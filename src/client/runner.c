@@ -228,31 +228,26 @@ static int parse_op_move(struct game *game, int fd) {
 }
 
 static int get_player_move(struct frontend *frontend, struct game *game, int peer) {
-	char *move;
+	char move[MOVE_STRING_LEN];
 	int move_code;
 	frontend->report_msg(frontend->aux, "Make your move");
 	for (;;) {
-		move = frontend->get_move(frontend->aux, get_player(game));
-		if (move == NULL) {
+		if (frontend->get_move(frontend->aux, get_player(game), move) < 0) {
 			return IO_ERROR;
 		}
 		move_code = parse_move(game, move);
 		switch (move_code) {
 		case ILLEGAL_MOVE:
 			frontend->report_msg(frontend->aux, "Illegal move!");
-			free(move);
 			continue;
 		case MISSING_PROMOTION:
 			frontend->report_error(frontend->aux, MISSING_PROMOTION);
-			free(move);
 			continue;
 		}
 		break;
 	}
 	if (write(peer, move, strlen(move)+1) < 5) {
-		free(move);
 		return IO_ERROR;
 	}
-	free(move);
 	return move_code;
 }
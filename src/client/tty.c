@@ -23,10 +23,9 @@
  * future. */
 
 #include <stdio.h>
+#include <string.h>
 #include <stdlib.h>
 
-#include <readline/readline.h>
-
 #include <util.h>
 
 #include <client/chess.h>
@@ -35,9 +34,12 @@
 struct aux {
 	wchar_t **piecesyms_white;
 	wchar_t **piecesyms_black;
+	/* moves are read in here, it lives as long as the frontend does so that
+	 * reading a move doesn't have to allocate anything */
+	char line[64];
 };
 
-static char *get_move(void *aux, enum player player);
+static int get_move(void *aux, enum player player, char buff[MOVE_STRING_LEN]);
 static void report_error(void *aux, int code);
 static void report_msg(void *aux, char *msg);
 static void print_letters(enum player player);
@@ -65,15 +67,28 @@ struct frontend *new_text_frontend(wchar_t **piecesyms_white, wchar_t **piecesym
 	return ret;
 }
 
-static char *get_move(void *aux, enum player player) {
-	char *move;
-	UNUSED(aux);
+static int get_move(void *aux, enum player player, char buff[MOVE_STRING_LEN]) {
+	char *line = ((struct aux *) aux)->line;
+	size_t len;
 	UNUSED(player);
-	move = readline("Your move: ");
-	if (move == NULL) {
-		return NULL;
+	fputs("Your move: ", stdout);
+	fflush(stdout);
+	if (fgets(line, sizeof ((struct aux *) aux)->line, stdin) == NULL) {
+		return -1;
+	}
+	len = strcspn(line, "\n");
+	/* anything that didn't fit is too long to be a move anyways */
+	if (line[len] != '\n') {
+		int ch;
+		while ((ch = getchar()) != EOF && ch != '\n') ;
+	}
+	/* parse_move ignores anything after the promotion */
+	if (len >= MOVE_STRING_LEN) {
+		len = MOVE_STRING_LEN - 1;
 	}
-	return move;
+	memcpy(buff, line, len);
+	buff[len] = '\0';
+	return 0;
 }
 
 static void report_error(void *aux, int code) {
@@ -110,7 +125,8 @@ static void display_board(void *aux, struct game *game, enum player player) {
 		printf("%d ", 8 - row);
 		for (int j = 0; j < 8; ++j) {
 			int col = player == 0 ? j : 7-j;
-			struct piece *piece = &game->board.board[row][col];
+			struct piece piece_s = get_piece(game, row, col);
+			struct piece *piece = &piece_s;
 			wchar_t **piecesyms = (piece->type == EMPTY || piece->player == WHITE) ? dissected->piecesyms_white : dissected->piecesyms_black;
 			printf("%ls", piecesyms[piece->type]);
 		}
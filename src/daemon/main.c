@@ -21,7 +21,7 @@
 #include <getopt.h>
 
 #include <legal.h>
-#include <daemon/sock.h>
+#include <sock.h>
 #include <daemon/runner.h>
 
 struct daemon_args {
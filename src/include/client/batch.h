@@ -0,0 +1,51 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+#ifndef HAVE_CLIENT__BATCH
+#define HAVE_CLIENT__BATCH
+
+#include <client/chess.h>
+
+#pragma GCC visibility push(default)
+
+/* Entry points for running the engine over many moves or positions in one
+ * call, for bots and analysis tools that link against libchessh instead of
+ * running `chessh-client -t`. None of these touch any global state, so they
+ * can be called from any number of threads at once. */
+
+/* checks every move in `moves` against the position in `game` without making
+ * any of them. results[i] is 0 if moves[i] is legal, otherwise ILLEGAL_MOVE or
+ * MISSING_PROMOTION. */
+extern void validate_moves(const struct game *game, const struct move *moves, int n,
+		int *results);
+
+/* returns the number of positions `depth` plies below `game`. the moves at
+ * the last ply are counted without being made. */
+extern unsigned long long count_positions(struct game *game, int depth);
+
+/* results[i] is the number of positions `depth` plies after the FEN string
+ * fens[i], or -1 if fens[i] isn't valid. returns -1 if the engine couldn't
+ * allocate a game, 0 otherwise. */
+extern int perft_positions(const char *const *fens, int n, int depth, long long *results);
+
+/* results[i] is what `game_status` says about fens[i], or ILLEGAL_MOVE if
+ * fens[i] isn't valid. returns -1 if the engine couldn't allocate a game, 0
+ * otherwise. */
+extern int game_statuses(const char *const *fens, int n, int *results);
+
+#pragma GCC visibility pop
+
+#endif
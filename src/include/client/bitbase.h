@@ -0,0 +1,90 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef HAVE_CLIENT__BITBASE
+#define HAVE_CLIENT__BITBASE
+
+#include <client/chess.h>
+
+/* Endgame tables for king and pawn/rook/queen against a lone king. They're
+ * built by src/tools/genbitbases.c when the client is compiled.
+ *
+ * Every entry is 0 if the position is a draw (or can't happen), otherwise the
+ * side with the extra piece wins and the entry is one more than the number of
+ * plies until mate with best play on both sides.
+ *
+ * Positions are always seen from the strong side's point of view: the strong
+ * side plays "up" the board like white does, and `strong_to_move` says whose
+ * turn it is. The index functions below are shared with the generator, so the
+ * tables can't get out of sync with the way they're read. */
+
+#define KPK_SIZE (2 * 24 * 64 * 64)
+#define KXK_SIZE (2 * 10 * 64 * 64)
+
+/* the a8-d8-d5 triangle, -1 outside of it */
+static const signed char bitbase_triangle[64] = {
+	 0,  1,  2,  3, -1, -1, -1, -1,
+	-1,  4,  5,  6, -1, -1, -1, -1,
+	-1, -1,  7,  8, -1, -1, -1, -1,
+	-1, -1, -1,  9, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+/* returns the index of the position in the KPK table. the strong side's pawn
+ * moves towards row 0. */
+static inline int kpk_index(int strong_to_move, int strong_king, int pawn, int weak_king) {
+	/* mirror so that the pawn is on the a-d files */
+	if (pawn % 8 > 3) {
+		strong_king ^= 7;
+		pawn ^= 7;
+		weak_king ^= 7;
+	}
+	return ((strong_to_move * 24 + (pawn / 8 - 1) * 4 + pawn % 8) * 64 +
+			strong_king) * 64 + weak_king;
+}
+
+/* returns the index of the position in the KQK or KRK table */
+static inline int kxk_index(int strong_to_move, int strong_king, int piece, int weak_king) {
+	/* mirror the board until the strong king is in the triangle */
+	if (strong_king % 8 > 3) {
+		strong_king ^= 7;
+		piece ^= 7;
+		weak_king ^= 7;
+	}
+	if (strong_king / 8 > 3) {
+		strong_king ^= 56;
+		piece ^= 56;
+		weak_king ^= 56;
+	}
+	if (strong_king / 8 > strong_king % 8) {
+		strong_king = strong_king % 8 * 8 + strong_king / 8;
+		piece = piece % 8 * 8 + piece / 8;
+		weak_king = weak_king % 8 * 8 + weak_king / 8;
+	}
+	return ((strong_to_move * 10 + bitbase_triangle[strong_king]) * 64 +
+			piece) * 64 + weak_king;
+}
+
+/* returns -1 if the position isn't covered by the tables, otherwise the
+ * table entry described above. `strong` is set to the side with the extra
+ * piece. */
+extern int probe_bitbase(const struct game *game, enum player *strong);
+
+#endif
@@ -0,0 +1,229 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef HAVE_CLIENT__BITBOARD
+#define HAVE_CLIENT__BITBOARD
+
+#include <stdint.h>
+#include <stdbool.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <client/chess.h>
+#include <client/tables.h>
+
+/* Squares are numbered in the same order as `struct board`, so square 0 is a8,
+ * square 7 is h8, and square 63 is h1. Bit N of a bitboard is square N. */
+#define SQUARE(r, c) ((r) * 8 + (c))
+#define ROW(sq) ((sq) / 8)
+#define COL(sq) ((sq) % 8)
+#define BIT(sq) (UINT64_C(1) << (sq))
+
+#define FILE_A UINT64_C(0x0101010101010101)
+#define FILE_B (FILE_A << 1)
+#define FILE_G (FILE_A << 6)
+#define FILE_H (FILE_A << 7)
+
+/* a8 is a light square */
+#define LIGHT_SQUARES UINT64_C(0xaa55aa55aa55aa55)
+
+/* ROW_N is the Nth row of `struct board`, not the Nth rank */
+#define ROW_0 UINT64_C(0x00000000000000ff)
+#define ROW_2 (ROW_0 << 16)
+#define ROW_5 (ROW_0 << 40)
+#define ROW_7 (ROW_0 << 56)
+
+static inline int lsb(uint64_t bb) {
+	return __builtin_ctzll(bb);
+}
+
+static inline int popcount(uint64_t bb) {
+	return __builtin_popcountll(bb);
+}
+
+/* removes and returns the lowest set square */
+static inline int pop_lsb(uint64_t *bb) {
+	int ret = lsb(*bb);
+	*bb &= *bb - 1;
+	return ret;
+}
+
+/* "north" is towards black's side of the board (row 0) */
+static inline uint64_t shift_north(uint64_t bb) { return bb >> 8; }
+static inline uint64_t shift_south(uint64_t bb) { return bb << 8; }
+static inline uint64_t shift_east(uint64_t bb)  { return (bb << 1) & ~FILE_A; }
+static inline uint64_t shift_west(uint64_t bb)  { return (bb >> 1) & ~FILE_H; }
+
+/* the squares attacked by all of the knights in `bb` */
+static inline uint64_t knight_fill(uint64_t bb) {
+	uint64_t l1, l2, r1, r2, h1, h2;
+	l1 = (bb >> 1) & ~FILE_H;
+	l2 = (bb >> 2) & ~(FILE_G | FILE_H);
+	r1 = (bb << 1) & ~FILE_A;
+	r2 = (bb << 2) & ~(FILE_A | FILE_B);
+	h1 = l1 | r1;
+	h2 = l2 | r2;
+	return (h1 << 16) | (h1 >> 16) | (h2 << 8) | (h2 >> 8);
+}
+
+static inline uint64_t king_fill(uint64_t bb) {
+	uint64_t ret = bb | shift_east(bb) | shift_west(bb);
+	return (ret | shift_north(ret) | shift_south(ret)) & ~bb;
+}
+
+/* the squares attacked by all of `player`'s pawns in `bb` */
+static inline uint64_t pawn_fill(uint64_t bb, enum player player) {
+	if (player == WHITE) {
+		bb = shift_north(bb);
+	}
+	else {
+		bb = shift_south(bb);
+	}
+	return shift_east(bb) | shift_west(bb);
+}
+
+static inline uint64_t knight_attacks(int sq) {
+	return knight_table[sq];
+}
+
+static inline uint64_t king_attacks(int sq) {
+	return king_table[sq];
+}
+
+/* the squares that a pawn owned by `player` on `sq` attacks */
+static inline uint64_t pawn_attacks(int sq, enum player player) {
+	return pawn_table[player][sq];
+}
+
+/* These turn a question about the mailbox into a bitboard of the squares where
+ * the answer is yes. `squares` has to be a `struct board`'s mailbox, or at least
+ * be 64-byte aligned. */
+
+/* the squares that hold exactly `piece`, which can be EMPTY */
+static inline uint64_t mailbox_match(const unsigned char squares[64], unsigned char piece) {
+	uint64_t ret = 0;
+#ifdef __SSE2__
+	const __m128i needle = _mm_set1_epi8((char) piece);
+	for (int i = 0; i < 4; ++i) {
+		__m128i chunk = _mm_load_si128((const __m128i *) (squares + i*16));
+		ret |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)) << i*16;
+	}
+#else
+	for (int sq = 0; sq < 64; ++sq) {
+		ret |= (uint64_t) (squares[sq] == piece) << sq;
+	}
+#endif
+	return ret;
+}
+
+static inline uint64_t mailbox_empty(const unsigned char squares[64]) {
+	return mailbox_match(squares, EMPTY);
+}
+
+/* the squares that hold one of `player`'s pieces */
+static inline uint64_t mailbox_player(const unsigned char squares[64], enum player player) {
+	uint64_t black = 0;
+#ifdef __SSE2__
+	const __m128i owner = _mm_set1_epi8(PIECE(0, BLACK));
+	for (int i = 0; i < 4; ++i) {
+		__m128i chunk = _mm_load_si128((const __m128i *) (squares + i*16));
+		chunk = _mm_and_si128(chunk, owner);
+		black |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, owner)) << i*16;
+	}
+#else
+	for (int sq = 0; sq < 64; ++sq) {
+		black |= (uint64_t) (PIECE_PLAYER(squares[sq]) == BLACK) << sq;
+	}
+#endif
+	/* EMPTY doesn't have the owner bit set, so it looks like white */
+	return player == BLACK ? black : ~black & ~mailbox_empty(squares);
+}
+
+struct magic {
+	uint64_t mask; /* the squares that can block the slider */
+	uint64_t magic;
+	int shift;
+	uint64_t *attacks;
+};
+
+extern struct magic rook_magics[64];
+extern struct magic bishop_magics[64];
+
+/* set by `init_bitboards` if the cpu has a fast `pext` instruction */
+extern bool have_pext;
+
+/* returns the squares attacked by the rook movers in `rooks` and the bishop
+ * movers in `bishops`, `empty` is the set of empty squares. this is set by
+ * `init_bitboards` to the best Kogge-Stone fill that the cpu supports. */
+extern uint64_t (*slider_fill)(uint64_t rooks, uint64_t bishops, uint64_t empty);
+
+/* fills in the sliding piece attack tables, this has to be called before any of
+ * the *_attacks functions are used. calling it more than once is harmless. */
+extern void init_bitboards(void);
+
+static inline uint64_t magic_index(const struct magic *magic, uint64_t occupied) {
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (have_pext) {
+		uint64_t ret;
+		__asm__ ("pextq %2, %1, %0" : "=r" (ret) : "r" (occupied), "r" (magic->mask));
+		return ret;
+	}
+#endif
+	return ((occupied & magic->mask) * magic->magic) >> magic->shift;
+}
+
+static inline uint64_t rook_attacks(int sq, uint64_t occupied) {
+	const struct magic *magic = &rook_magics[sq];
+	return magic->attacks[magic_index(magic, occupied)];
+}
+
+static inline uint64_t bishop_attacks(int sq, uint64_t occupied) {
+	const struct magic *magic = &bishop_magics[sq];
+	return magic->attacks[magic_index(magic, occupied)];
+}
+
+static inline uint64_t queen_attacks(int sq, uint64_t occupied) {
+	return rook_attacks(sq, occupied) | bishop_attacks(sq, occupied);
+}
+
+/* returns every square attacked by `pieces`, a set of bitboards indexed by
+ * piece type belonging to `player`, when the board's occupancy is `occupied`.
+ * this is inline so that callers passing a constant `player` get the pawn
+ * shifts resolved at compile time. */
+static inline uint64_t attack_map(const uint64_t pieces[6], uint64_t occupied,
+		enum player player) {
+	return pawn_fill(pieces[PAWN], player) |
+		knight_fill(pieces[KNIGHT]) |
+		king_fill(pieces[KING]) |
+		slider_fill(pieces[ROOK] | pieces[QUEEN],
+				pieces[BISHOP] | pieces[QUEEN], ~occupied);
+}
+
+/* the squares strictly between `a` and `b`, or 0 if they aren't on the same
+ * rank, file or diagonal */
+static inline uint64_t between(int a, int b) {
+	return between_table[a][b];
+}
+
+/* the whole rank, file or diagonal going through `a` and `b`, or 0 if there
+ * isn't one */
+static inline uint64_t line(int a, int b) {
+	return line_table[a][b];
+}
+
+#endif
@@ -18,8 +18,13 @@
 #ifndef HAVE_CLIENT__CHESS
 #define HAVE_CLIENT__CHESS
 
+#include <stdint.h>
 #include <stdbool.h>
 
+/* libchessh is built with -fvisibility=hidden, so only what's declared here
+ * and in client/batch.h gets exported */
+#pragma GCC visibility push(default)
+
 enum piece_type {
 	ROOK,
 	KNIGHT,
@@ -35,46 +40,125 @@ enum player {
 	BLACK
 };
 
+/* what the frontends get back from `get_piece` */
 struct piece {
 	enum piece_type type;
 	enum player player;
-	int moves; /* total no. of times this piece has moved */
-	int last_move; /* last time this piece has moved */
 };
 
+/* every square of the mailbox is a single byte, the low three bits are the
+ * piece type and the next bit is the owner. empty squares are just EMPTY. */
+#define PIECE(type, player) ((unsigned char) ((type) | (player) << 3))
+#define PIECE_TYPE(piece) ((enum piece_type) ((piece) & 7))
+#define PIECE_PLAYER(piece) ((enum player) ((piece) >> 3 & 1))
+
 struct board {
-	/* board[0][N] = first row black
-	 * board[1][N] = second row black
-	 * board[0][3] = black queen
+	/* squares[0..7] = first row black
+	 * squares[8..15] = second row black
+	 * squares[3] = black queen
 	 *
-	 * Basically in reading order from white's perspective */
-	struct piece board[8][8];
+	 * Basically in reading order from white's perspective, square N is on
+	 * row N/8 and column N%8. The whole mailbox sits in one cache line so
+	 * that it can be scanned with a few vector compares, see the mailbox_*
+	 * functions in client/bitboard.h. */
+	_Alignas(64) unsigned char squares[64];
+
+	/* these are also kept up to date with the mailbox. king[player] is the
+	 * square of that player's king, or -1 if it's missing. */
+	signed char king[2];
+	unsigned char count[2][6];
+
+	/* The engine itself works on bitboards. pieces[player][type] has a bit
+	 * set for every square that holds that kind of piece, see
+	 * client/bitboard.h for more. */
+	uint64_t pieces[2][6];
+	uint64_t occupied[2];
+	uint64_t all;
 };
 
+#define CASTLE_WHITE_KING  1
+#define CASTLE_WHITE_QUEEN 2
+#define CASTLE_BLACK_KING  4
+#define CASTLE_BLACK_QUEEN 8
+
 struct game {
 	struct board board;
 	int duration; /* no. of turns played, includes both black and white's
 			 moves */
-	int last_big_move; /* Last capture/pawn move, for the 50 move rule */
+	int halfmove; /* turns since the last capture/pawn move, for the 50
+			 move rule */
+	unsigned char castling; /* CASTLE_* rights that are still available */
+	/* the square that a pawn can move to to take en pessant, or -1. this is
+	 * only set if one of the current player's pawns is in position to do
+	 * it. */
+	signed char pessant;
+
+	/* Zobrist hash of the piece placement, side to move, castling rights,
+	 * and en pessant file, kept up to date by every move */
+	uint64_t hash;
+
+	/* the legal moves of the position that was last checked for game over,
+	 * so that validating the next move is just a lookup. this isn't part
+	 * of the position, it's only trusted when its hash matches `hash`. */
+	struct legal_cache *legal;
+
+	/* the hashes of the positions since the last capture or pawn move, for
+	 * spotting repetitions. this is kept by `make_move`, `do_move` leaves
+	 * it alone. */
+	struct history *history;
 };
 
 struct move {
-	/* initial row/column */
-	int r_i;
-	int c_i;
+	/* bits 0-5 are the initial square, bits 6-11 are the final square, and
+	 * bits 12-14 are the piece to promote to, if valid. if unspecified by
+	 * the user, the promotion is EMPTY. */
+	uint16_t bits;
+};
+
+static inline struct move new_move(int r_i, int c_i, int r_f, int c_f, enum piece_type promotion) {
+	struct move ret;
+	ret.bits = (uint16_t) ((r_i * 8 + c_i) | (r_f * 8 + c_f) << 6 | promotion << 12);
+	return ret;
+}
+
+static inline int move_from(const struct move *move) {
+	return move->bits & 63;
+}
+
+static inline int move_to(const struct move *move) {
+	return move->bits >> 6 & 63;
+}
+
+static inline enum piece_type move_promotion(const struct move *move) {
+	return (enum piece_type) (move->bits >> 12 & 7);
+}
+
+/* everything `undo_move` needs to take back a move made with `do_move` */
+struct undo {
+	struct move move;
+	unsigned char moved; /* the moving piece as it was before the move */
+	unsigned char taken; /* whatever was on the destination square */
+	unsigned char castling;
+	signed char pessant;
+	int halfmove;
+	uint64_t hash;
+};
 
-	/* final row/column */
-	int r_f;
-	int c_f;
+/* no legal chess position has more than 218 legal moves */
+#define MAX_MOVES 256
 
-	/* promote to this piece, if valid. if unspecified by the user, set to
-	 * EMPTY */
-	enum piece_type promotion;
+struct move_list {
+	struct move moves[MAX_MOVES];
+	int len;
 };
 
 extern struct game *new_game(void);
 extern void free_game(struct game *game);
 
+/* makes `dst` a copy of `src`, both have to come from `new_game`. the copy
+ * shares nothing with the original, so it can be handed to another thread. */
+extern void copy_game(struct game *dst, const struct game *src);
+
 #define ILLEGAL_MOVE -1
 #define WHITE_WIN -2
 #define BLACK_WIN -3
@@ -86,19 +170,73 @@ extern void free_game(struct game *game);
 #define NONFATAL_ERROR ILLEGAL_MOVE: case MISSING_PROMOTION
 
 /* returns >=0 on success */
-extern int make_move(struct game *game, struct move *move);
+extern int make_move(struct game *game, const struct move *move);
+
+/* returns WHITE_WIN, BLACK_WIN, FORCED_DRAW or DRAW_OFFER if the game is over
+ * (or nearly over) in the current position, or 0 if it goes on. repetitions
+ * are only noticed by `make_move`. */
+extern int game_status(struct game *game);
+
+/* Plays `move` without checking it, for moves that came out of
+ * `generate_legal_moves`. Enough state to take the move back is saved in
+ * `undo`, which the caller owns. Moves have to be undone in the reverse order
+ * that they were made in. */
+extern void do_move(struct game *game, const struct move *move, struct undo *undo);
+extern void undo_move(struct game *game, struct undo *undo);
 
 /* 0 on success, -1 on failure, uses Forsyth-Edwards Notation
  *
  * https://en.wikipedia.org/wiki/Forsyth%E2%80%93Edwards_Notation
+ *
+ * The position has to be one that can come up in a game: one king each, no
+ * pawns on the back ranks, and the player who isn't moving can't be in check.
+ * The clocks at the end can be left out. If this fails the game has to be
+ * initialized again before it's used.
  * */
-extern int init_game(struct game *game, char *state);
+extern int init_game(struct game *game, const char *state);
 
-extern enum player get_player(struct game *game);
+/* like `init_game`, but the FEN only runs up to the next newline, so a whole
+ * buffer of them can be read one after another. `*next` is always set to the
+ * start of the next line (or the end of the string), even on failure. */
+extern int parse_fen(struct game *game, const char *fen, const char **next);
 
-extern int parse_move(struct game *game, char *move);
+/* enough for any FEN that `game_to_fen` can write */
+#define FEN_MAX_LEN 100
 
-extern char *move_to_string(struct move *move);
+/* writes the position out as FEN and returns `buff`. the en pessant square is
+ * only written if a pawn can actually take on it. */
+extern char *game_to_fen(const struct game *game, char buff[FEN_MAX_LEN]);
+
+extern enum player get_player(const struct game *game);
+
+extern struct piece get_piece(const struct game *game, int row, int col);
+
+/* returns the squares of the pieces giving check to the player to move, bit N
+ * is square N (row * 8 + col). more than one bit means a double check. */
+extern uint64_t get_checkers(const struct game *game);
+
+/* two games with the same hash are almost certainly in the same position */
+extern uint64_t game_hash(const struct game *game);
+
+/* fills `list` with every legal move that the current player can make. pawn
+ * promotions show up once for every piece they can promote to. returns the
+ * number of legal moves. */
+extern int generate_legal_moves(const struct game *game, struct move_list *list);
+
+/* returns the index of `move` in `list`, a list of legal moves, or
+ * ILLEGAL_MOVE. MISSING_PROMOTION is returned if `move` is only legal with a
+ * promotion. */
+extern int find_legal_move(const struct move_list *list, const struct move *move);
+
+extern int parse_move(struct game *game, const char *move);
+
+/* the longest move string is something like "e7e8q" */
+#define MOVE_STRING_LEN 6
+
+/* writes `move` into `buff` and returns `buff` */
+extern char *move_to_string(const struct move *move, char buff[MOVE_STRING_LEN]);
 extern char piece_to_char(enum piece_type piece);
 
+#pragma GCC visibility pop
+
 #endif
@@ -21,7 +21,10 @@
 #include <client/chess.h>
 
 struct frontend {
-	char *(*get_move)(void *aux, enum player player);
+	/* writes the player's move into `move`, returns 0 on success or -1 if
+	 * no move could be read. this happens on every move, so it shouldn't
+	 * allocate anything. */
+	int (*get_move)(void *aux, enum player player, char move[MOVE_STRING_LEN]);
 
 	/* Used for things that the frontend can fix, currently only used when a
 	 * pawn is missing a promotion. The error always refers to the last
@@ -20,6 +20,35 @@
 
 #include <stdbool.h>
 
-extern int run_perft(int level, char *start_pos, char *start_sequence, bool autotest);
+/* how the results get printed. PERFT_TABLE and PERFT_CSV also break the nodes
+ * at every ply down into captures, checks and so on. */
+enum perft_format {
+	PERFT_PLAIN,
+	PERFT_TABLE,
+	PERFT_CSV,
+};
+
+struct perft_options {
+	int level;
+	char *start_pos;
+	char *start_sequence;
+	bool autotest;
+	/* the size of the transposition table in megabytes, 0 turns it off */
+	int table_mb;
+	int threads;
+	enum perft_format format;
+	/* where progress gets saved, or NULL. if `resume` is set the test is
+	 * read back out of it instead of coming from the other options. */
+	char *checkpoint;
+	bool resume;
+	/* if `coordinator` is set, the test is handed out in pieces to worker
+	 * processes that connect to that socket. if `worker` is set, this
+	 * process is one of those workers, and only `table_mb` and `threads`
+	 * matter. */
+	char *coordinator;
+	char *worker;
+};
+
+extern int run_perft(struct perft_options *options);
 
 #endif
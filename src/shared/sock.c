@@ -0,0 +1,85 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+#include <sock.h>
+
+/* removes the socket at `addr` if it was left behind by a process that died
+ * without cleaning up, which is what stops it from being bound to again.
+ * anything that isn't a socket, or that something is still listening on, is
+ * left alone. returns 0 if it was removed, otherwise -1 and sets errno. */
+static int remove_stale(const struct sockaddr_un *addr);
+
+int setup_unix_sock(char *path) {
+	int fd;
+	struct sockaddr_un addr;
+
+	if (strlen(path) >= sizeof addr.sun_path) {
+		fprintf(stderr, "Socket path %s is too long\n", path);
+		return -1;
+	}
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("socket() failed");
+		return -1;
+	}
+
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof addr) < 0 &&
+	    (errno != EADDRINUSE || remove_stale(&addr) < 0 ||
+	     bind(fd, (struct sockaddr *) &addr, sizeof addr) < 0)) {
+		fprintf(stderr, "Failed to bind to %s: %s\n", path, strerror(errno));
+		goto error;
+	}
+
+	if (listen(fd, 1024)) {
+		fprintf(stderr, "Failed to listen on %s: %s\n", path, strerror(errno));
+		goto error;
+	}
+
+	return fd;
+error:
+	close(fd);
+	return -1;
+}
+
+static int remove_stale(const struct sockaddr_un *addr) {
+	struct stat st;
+	int fd, live;
+
+	if (stat(addr->sun_path, &st) < 0 || !S_ISSOCK(st.st_mode) ||
+	    (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		errno = EADDRINUSE;
+		return -1;
+	}
+	live = connect(fd, (const struct sockaddr *) addr, sizeof *addr) == 0 ||
+		errno != ECONNREFUSED;
+	close(fd);
+	if (live) {
+		errno = EADDRINUSE;
+		return -1;
+	}
+	return unlink(addr->sun_path);
+}
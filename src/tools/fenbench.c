@@ -0,0 +1,150 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+/* Measures how fast positions can be written out with `game_to_fen` and read
+ * back in with `parse_fen`. The positions come from random games, so they've
+ * got a realistic mix of castling rights, en pessant squares and clocks. Run
+ * it with `make bench`. */
+
+#include <time.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <client/chess.h>
+
+/* every position is a whole game from `new_game`, which is a few kilobytes */
+#define POSITIONS 20000
+#define ROUNDS 20
+
+#define START_POSITION "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+/* fills `games` with positions from random games, using `scratch` to play
+ * them. returns -1 if a game couldn't be allocated. */
+static int make_positions(struct game *scratch, struct game **games, int count);
+
+static double now(void);
+
+int main(void) {
+	static struct game *games[POSITIONS];
+	struct game *game;
+	char *buff, *end, fen[FEN_MAX_LEN];
+	const char *next;
+	double best_write, best_read;
+	int count, failed;
+
+	if ((game = new_game()) == NULL ||
+	    (buff = malloc((size_t) POSITIONS * FEN_MAX_LEN)) == NULL ||
+	    make_positions(game, games, POSITIONS)) {
+		fputs("Failed to initialize variables\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	best_write = best_read = 0;
+	for (int round = 0; round < ROUNDS; ++round) {
+		double start, elapsed;
+
+		start = now();
+		end = buff;
+		for (int i = 0; i < POSITIONS; ++i) {
+			end += strlen(game_to_fen(games[i], end));
+			*end++ = '\n';
+		}
+		*end = '\0';
+		elapsed = now() - start;
+		if (round == 0 || elapsed < best_write) {
+			best_write = elapsed;
+		}
+
+		start = now();
+		count = failed = 0;
+		for (next = buff; *next != '\0'; ++count) {
+			failed |= parse_fen(game, next, &next);
+		}
+		elapsed = now() - start;
+		if (failed) {
+			fputs("parse_fen rejected a position\n", stderr);
+			return EXIT_FAILURE;
+		}
+		if (round == 0 || elapsed < best_read) {
+			best_read = elapsed;
+		}
+	}
+
+	/* everything has to come back exactly the way it went out. the hash
+	 * doesn't cover the clocks, so the FEN is written out again too. */
+	next = buff;
+	for (int i = 0; i < POSITIONS; ++i) {
+		const char *line = next;
+		size_t len;
+
+		parse_fen(game, next, &next);
+		len = strlen(game_to_fen(game, fen));
+		if (game_hash(game) != game_hash(games[i]) ||
+		    (size_t) (next - line) != len + 1 || memcmp(fen, line, len) != 0) {
+			fprintf(stderr, "Position %d didn't survive the trip\n", i);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("%d positions, %.1f bytes each\n", count, (double) (end - buff) / count);
+	printf("game_to_fen: %.2f M positions/s\n", count / best_write / 1e6);
+	printf("parse_fen:   %.2f M positions/s\n", count / best_read / 1e6);
+
+	for (int i = 0; i < POSITIONS; ++i) {
+		free_game(games[i]);
+	}
+	free(buff);
+	free_game(game);
+	return EXIT_SUCCESS;
+}
+
+static int make_positions(struct game *scratch, struct game **games, int count) {
+	uint64_t seed = UINT64_C(0x9e3779b97f4a7c15);
+	struct move_list list;
+	int plies = 0;
+
+	init_game(scratch, START_POSITION);
+	for (int i = 0; i < count; ++i) {
+		struct undo undo;
+
+		if (generate_legal_moves(scratch, &list) == 0 || plies >= 200) {
+			init_game(scratch, START_POSITION);
+			generate_legal_moves(scratch, &list);
+			plies = 0;
+		}
+		/* xorshift64 */
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		do_move(scratch, &list.moves[seed % list.len], &undo);
+		++plies;
+		if ((games[i] = new_game()) == NULL) {
+			return -1;
+		}
+		/* a plain struct copy would share the caches behind the pointers */
+		copy_game(games[i], scratch);
+	}
+	return 0;
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
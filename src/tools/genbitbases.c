@@ -0,0 +1,364 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+/* Builds the KPK, KQK and KRK endgame tables by retrograde analysis and prints
+ * them to stdout as a header. The Makefile runs this to produce
+ * work/client/bitbases.h, see client/bitbase.h for the table layout. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <client/bitbase.h>
+/* this program gets its own copy of the geometry tables */
+#define CLIENT_TABLES_DEFINE
+#include <client/tables.h>
+
+#define BIT(sq) (UINT64_C(1) << (sq))
+
+/* nothing in these tables is anywhere near 255 plies from mate */
+#define MAX_LEVEL 255
+
+struct position {
+	int strong_to_move;
+	int strong_king;
+	int piece;
+	int weak_king;
+	/* EMPTY if the weak king just took the piece */
+	enum piece_type type;
+};
+
+struct table {
+	const char *name;
+	enum piece_type type;
+	int size;
+	unsigned char *value;
+	/* true once the value of the position is final */
+	bool *resolved;
+};
+
+static unsigned char kpk_value[KPK_SIZE], kqk_value[KXK_SIZE], krk_value[KXK_SIZE];
+static bool kpk_resolved[KPK_SIZE], kqk_resolved[KXK_SIZE], krk_resolved[KXK_SIZE];
+
+static struct table kpk = { "kpk_table", PAWN, KPK_SIZE, kpk_value, kpk_resolved };
+static struct table kqk = { "kqk_table", QUEEN, KXK_SIZE, kqk_value, kqk_resolved };
+static struct table krk = { "krk_table", ROOK, KXK_SIZE, krk_value, krk_resolved };
+
+/* turns a table index back into a position */
+static void decode(struct table *table, int index, struct position *pos);
+
+/* returns the current table entry for `pos`. promotions are looked up in the
+ * KQK and KRK tables, anything else without a piece is a draw. */
+static int lookup(struct position *pos);
+
+/* the squares attacked by the strong side. the weak king doesn't block
+ * anything, it can't hide behind itself. */
+static uint64_t strong_attacks(struct position *pos);
+
+static bool is_legal(struct position *pos);
+
+/* fills `children` with the positions reachable in one move and returns how
+ * many there are */
+static int children(struct position *pos, struct position children[64]);
+
+/* returns the value that `pos` gets at `level`, or -1 if it doesn't get one */
+static int evaluate(struct position *pos, int level);
+
+static void solve(struct table *table);
+static void print_table(struct table *table);
+
+int main(void) {
+	/* KPK promotes into the other two, so it has to go last */
+	solve(&kqk);
+	solve(&krk);
+	solve(&kpk);
+
+	puts("/* generated by src/tools/genbitbases.c, do not edit */");
+	puts("");
+	puts("#ifndef HAVE_CLIENT__BITBASES");
+	puts("#define HAVE_CLIENT__BITBASES");
+	puts("");
+	print_table(&kpk);
+	print_table(&kqk);
+	print_table(&krk);
+	puts("");
+	puts("#endif");
+
+	return ferror(stdout) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void decode(struct table *table, int index, struct position *pos) {
+	int rest;
+
+	pos->type = table->type;
+	pos->weak_king = index % 64;
+	index /= 64;
+
+	if (table->type == PAWN) {
+		pos->strong_king = index % 64;
+		index /= 64;
+		rest = index % 24;
+		pos->piece = (rest / 4 + 1) * 8 + rest % 4;
+		pos->strong_to_move = index / 24;
+		return;
+	}
+
+	pos->piece = index % 64;
+	index /= 64;
+	rest = index % 10;
+	for (int sq = 0; sq < 64; ++sq) {
+		if (bitbase_triangle[sq] == rest) {
+			pos->strong_king = sq;
+		}
+	}
+	pos->strong_to_move = index / 10;
+}
+
+static int lookup(struct position *pos) {
+	switch (pos->type) {
+	case PAWN:
+		return kpk_value[kpk_index(pos->strong_to_move, pos->strong_king,
+				pos->piece, pos->weak_king)];
+	case QUEEN:
+		return kqk_value[kxk_index(pos->strong_to_move, pos->strong_king,
+				pos->piece, pos->weak_king)];
+	case ROOK:
+		return krk_value[kxk_index(pos->strong_to_move, pos->strong_king,
+				pos->piece, pos->weak_king)];
+	default:
+		return 0;
+	}
+}
+
+static uint64_t strong_attacks(struct position *pos) {
+	uint64_t ret = king_table[pos->strong_king];
+	uint64_t occupied = BIT(pos->strong_king) | BIT(pos->piece);
+
+	switch (pos->type) {
+	case PAWN:
+		ret |= pawn_table[WHITE][pos->piece];
+		break;
+	case QUEEN: case ROOK:
+		for (int sq = 0; sq < 64; ++sq) {
+			bool straight = sq / 8 == pos->piece / 8 || sq % 8 == pos->piece % 8;
+			if (sq == pos->piece || !line_table[pos->piece][sq] ||
+			    (pos->type == ROOK && !straight)) {
+				continue;
+			}
+			if (!(between_table[pos->piece][sq] & occupied)) {
+				ret |= BIT(sq);
+			}
+		}
+		break;
+	default:
+		break;
+	}
+	return ret;
+}
+
+static bool is_legal(struct position *pos) {
+	if (pos->strong_king == pos->weak_king || pos->piece == pos->strong_king ||
+	    pos->piece == pos->weak_king) {
+		return false;
+	}
+	if (distance_table[pos->strong_king][pos->weak_king] <= 1) {
+		return false;
+	}
+	/* the weak king can't be in check when it isn't its turn */
+	if (pos->strong_to_move && (strong_attacks(pos) & BIT(pos->weak_king))) {
+		return false;
+	}
+	return true;
+}
+
+static int children(struct position *pos, struct position children[64]) {
+	struct position *child = children;
+	uint64_t targets;
+
+	if (!pos->strong_to_move) {
+		uint64_t attacked = strong_attacks(pos);
+		targets = king_table[pos->weak_king] & ~attacked;
+		for (int sq = 0; sq < 64; ++sq) {
+			if (!(targets & BIT(sq))) {
+				continue;
+			}
+			*child = *pos;
+			child->strong_to_move = 1;
+			child->weak_king = sq;
+			if (sq == pos->piece) {
+				child->type = EMPTY;
+			}
+			++child;
+		}
+		return child - children;
+	}
+
+	targets = king_table[pos->strong_king] & ~king_table[pos->weak_king] &
+		~BIT(pos->piece);
+	for (int sq = 0; sq < 64; ++sq) {
+		if (targets & BIT(sq)) {
+			*child = *pos;
+			child->strong_to_move = 0;
+			child->strong_king = sq;
+			++child;
+		}
+	}
+
+	if (pos->type == PAWN) {
+		int to = pos->piece - 8;
+		if (to == pos->strong_king || to == pos->weak_king) {
+			return child - children;
+		}
+		if (to < 8) {
+			/* knights and bishops can't win, so they're left out */
+			static const enum piece_type promotions[] = { QUEEN, ROOK };
+			for (int i = 0; i < 2; ++i) {
+				*child = *pos;
+				child->strong_to_move = 0;
+				child->piece = to;
+				child->type = promotions[i];
+				++child;
+			}
+			return child - children;
+		}
+		*child = *pos;
+		child->strong_to_move = 0;
+		child->piece = to;
+		++child;
+		to -= 8;
+		if (pos->piece / 8 == 6 && to != pos->strong_king && to != pos->weak_king) {
+			*child = *pos;
+			child->strong_to_move = 0;
+			child->piece = to;
+			++child;
+		}
+		return child - children;
+	}
+
+	for (int sq = 0; sq < 64; ++sq) {
+		uint64_t kings = BIT(pos->strong_king) | BIT(pos->weak_king);
+		if (sq == pos->piece || (kings & BIT(sq)) || !line_table[pos->piece][sq]) {
+			continue;
+		}
+		if (pos->type == ROOK && sq / 8 != pos->piece / 8 && sq % 8 != pos->piece % 8) {
+			continue;
+		}
+		if (between_table[pos->piece][sq] & kings) {
+			continue;
+		}
+		*child = *pos;
+		child->strong_to_move = 0;
+		child->piece = sq;
+		++child;
+	}
+	return child - children;
+}
+
+static int evaluate(struct position *pos, int level) {
+	struct position moves[64];
+	int count = children(pos, moves);
+	int best = pos->strong_to_move ? 0 : 1;
+
+	if (count == 0) {
+		/* checkmate is decided at level 1, stalemate is a draw */
+		if (level == 1 && !pos->strong_to_move &&
+		    (strong_attacks(pos) & BIT(pos->weak_king))) {
+			return 1;
+		}
+		return -1;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		int value = lookup(&moves[i]);
+		if (pos->strong_to_move) {
+			/* the strong side takes the quickest mate */
+			if (value > 0 && (best == 0 || value < best)) {
+				best = value;
+			}
+		}
+		else {
+			/* the weak side has to be lost everywhere and takes the slowest */
+			if (value == 0) {
+				return -1;
+			}
+			if (value > best) {
+				best = value;
+			}
+		}
+	}
+	return best == level - 1 ? level : -1;
+}
+
+static void solve(struct table *table) {
+	struct position pos;
+	int deepest = 0;
+
+	/* promotions can land on a mate that's deeper than anything in the table
+	 * so far, so don't stop before those have had a chance to show up */
+	if (table->type == PAWN) {
+		for (int i = 0; i < KXK_SIZE; ++i) {
+			if (kqk_value[i] > deepest) {
+				deepest = kqk_value[i];
+			}
+			if (krk_value[i] > deepest) {
+				deepest = krk_value[i];
+			}
+		}
+	}
+
+	for (int i = 0; i < table->size; ++i) {
+		decode(table, i, &pos);
+		table->value[i] = 0;
+		table->resolved[i] = !is_legal(&pos);
+	}
+
+	for (int level = 1; level <= MAX_LEVEL; ++level) {
+		bool progress = false;
+		for (int i = 0; i < table->size; ++i) {
+			int value;
+			if (table->resolved[i]) {
+				continue;
+			}
+			decode(table, i, &pos);
+			/* the strong side moves on even levels, the weak side on odd ones */
+			if (pos.strong_to_move != (level % 2 == 0)) {
+				continue;
+			}
+			value = evaluate(&pos, level);
+			if (value > 0) {
+				table->value[i] = value;
+				table->resolved[i] = true;
+				progress = true;
+			}
+		}
+		if (!progress && level > deepest + 1) {
+			break;
+		}
+	}
+}
+
+static void print_table(struct table *table) {
+	printf("static const unsigned char %s[%d] = {", table->name, table->size);
+	for (int i = 0; i < table->size; ++i) {
+		if (i % 16 == 0) {
+			printf("\n\t");
+		}
+		printf("%d,", table->value[i]);
+	}
+	puts("\n};");
+}
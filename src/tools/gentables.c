@@ -0,0 +1,188 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+/* Prints the attack and geometry tables used by the client's move generator to
+ * stdout. The Makefile runs this at build time to produce work/client/tables.h,
+ * so none of this has to be computed when chessh-client starts up. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* these have to match client/bitboard.h, which can't be included here since it
+ * depends on the output of this program */
+#define SQUARE(r, c) ((r) * 8 + (c))
+#define ROW(sq) ((sq) / 8)
+#define COL(sq) ((sq) % 8)
+#define BIT(sq) (UINT64_C(1) << (sq))
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+static uint64_t knight[64];
+static uint64_t king[64];
+static uint64_t pawn[2][64];
+static uint64_t between[64][64];
+static uint64_t line[64][64];
+static int distance[64][64];
+
+/* sets the bit for (r, c) in `bb` if it's on the board */
+static void add_square(uint64_t *bb, int r, int c);
+
+static void init_leapers(void);
+static void init_rays(void);
+
+static void print_table(const char *name, const uint64_t *table, int len);
+static void print_table_2d(const char *name, uint64_t (*table)[64], int len);
+
+int main(void) {
+	init_leapers();
+	init_rays();
+
+	puts("/* generated by src/tools/gentables.c, do not edit */");
+	puts("");
+	puts("#ifndef HAVE_CLIENT__TABLES");
+	puts("#define HAVE_CLIENT__TABLES");
+	puts("");
+	puts("#include <stdint.h>");
+	puts("");
+	puts("/* exactly one file defines CLIENT_TABLES_DEFINE before including this, every");
+	puts(" * other file just gets the declarations */");
+	puts("#ifndef CLIENT_TABLES_DEFINE");
+	puts("extern const uint64_t knight_table[64];");
+	puts("extern const uint64_t king_table[64];");
+	puts("extern const uint64_t pawn_table[2][64];");
+	puts("extern const uint64_t between_table[64][64];");
+	puts("extern const uint64_t line_table[64][64];");
+	puts("extern const unsigned char distance_table[64][64];");
+	puts("#else");
+	print_table("knight_table", knight, 64);
+	print_table("king_table", king, 64);
+	print_table_2d("pawn_table", pawn, 2);
+	print_table_2d("between_table", between, 64);
+	print_table_2d("line_table", line, 64);
+
+	puts("const unsigned char distance_table[64][64] = {");
+	for (int a = 0; a < 64; ++a) {
+		printf("\t{");
+		for (int b = 0; b < 64; ++b) {
+			printf("%s%d", b == 0 ? " " : ", ", distance[a][b]);
+		}
+		puts(" },");
+	}
+	puts("};");
+	puts("#endif");
+	puts("");
+	puts("#endif");
+
+	return ferror(stdout) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void add_square(uint64_t *bb, int r, int c) {
+	if (0 <= r && r < 8 && 0 <= c && c < 8) {
+		*bb |= BIT(SQUARE(r, c));
+	}
+}
+
+static void init_leapers(void) {
+	static const int knight_jumps[8][2] = {
+		{ -2, -1 }, { -2, 1 }, { -1, -2 }, { -1, 2 },
+		{ 1, -2 }, { 1, 2 }, { 2, -1 }, { 2, 1 },
+	};
+
+	for (int sq = 0; sq < 64; ++sq) {
+		int r = ROW(sq);
+		int c = COL(sq);
+
+		for (int i = 0; i < 8; ++i) {
+			add_square(&knight[sq], r + knight_jumps[i][0], c + knight_jumps[i][1]);
+		}
+		for (int dr = -1; dr <= 1; ++dr) {
+			for (int dc = -1; dc <= 1; ++dc) {
+				if (dr != 0 || dc != 0) {
+					add_square(&king[sq], r + dr, c + dc);
+				}
+			}
+		}
+		/* white is 0 and moves towards row 0, black is 1 */
+		add_square(&pawn[0][sq], r - 1, c - 1);
+		add_square(&pawn[0][sq], r - 1, c + 1);
+		add_square(&pawn[1][sq], r + 1, c - 1);
+		add_square(&pawn[1][sq], r + 1, c + 1);
+	}
+}
+
+static void init_rays(void) {
+	for (int a = 0; a < 64; ++a) {
+		for (int b = 0; b < 64; ++b) {
+			distance[a][b] = MAX(abs(ROW(a) - ROW(b)), abs(COL(a) - COL(b)));
+		}
+
+		for (int dr = -1; dr <= 1; ++dr) {
+			for (int dc = -1; dc <= 1; ++dc) {
+				uint64_t squares = 0;
+				uint64_t full = BIT(a);
+				int r, c;
+
+				if (dr == 0 && dc == 0) {
+					continue;
+				}
+
+				/* the whole line through `a` in this direction */
+				for (r = ROW(a) + dr, c = COL(a) + dc;
+						0 <= r && r < 8 && 0 <= c && c < 8;
+						r += dr, c += dc) {
+					full |= BIT(SQUARE(r, c));
+				}
+				for (r = ROW(a) - dr, c = COL(a) - dc;
+						0 <= r && r < 8 && 0 <= c && c < 8;
+						r -= dr, c -= dc) {
+					full |= BIT(SQUARE(r, c));
+				}
+
+				for (r = ROW(a) + dr, c = COL(a) + dc;
+						0 <= r && r < 8 && 0 <= c && c < 8;
+						r += dr, c += dc) {
+					between[a][SQUARE(r, c)] = squares;
+					line[a][SQUARE(r, c)] = full;
+					squares |= BIT(SQUARE(r, c));
+				}
+			}
+		}
+	}
+}
+
+static void print_table(const char *name, const uint64_t *table, int len) {
+	printf("const uint64_t %s[%d] = {\n", name, len);
+	for (int i = 0; i < len; ++i) {
+		printf("%sUINT64_C(0x%016llx),%s", i % 2 == 0 ? "\t" : " ",
+				(unsigned long long) table[i], i % 2 == 1 ? "\n" : "");
+	}
+	puts("};");
+}
+
+static void print_table_2d(const char *name, uint64_t (*table)[64], int len) {
+	printf("const uint64_t %s[%d][64] = {\n", name, len);
+	for (int i = 0; i < len; ++i) {
+		puts("\t{");
+		for (int j = 0; j < 64; ++j) {
+			printf("%sUINT64_C(0x%016llx),%s", j % 2 == 0 ? "\t\t" : " ",
+					(unsigned long long) table[i][j], j % 2 == 1 ? "\n" : "");
+		}
+		puts("\t},");
+	}
+	puts("};");
+}
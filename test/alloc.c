@@ -0,0 +1,178 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+/* Plays a few games through the same path a move takes during a real game:
+ * the text frontend reads it, it's played on our board, sent to the peer over
+ * a socket and played on theirs. Once a game has started none of this should
+ * allocate anything. Linked with -Wl,--wrap=malloc (and calloc and realloc)
+ * so that every allocation made by the engine or the frontend is counted. */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <client/chess.h>
+#include <client/frontend.h>
+
+#define GAMES 8
+#define MAX_PLIES 400
+
+extern void *__real_malloc(size_t size);
+extern void *__real_calloc(size_t nmemb, size_t size);
+extern void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+static unsigned long allocations;
+
+/* plays one game where the moves are picked with `stride`, returns the number
+ * of moves that allocated something or -1 if the game couldn't be played */
+static int play_game(struct frontend *frontend, int input, int sock[2], int stride);
+
+int main(void) {
+	struct frontend *frontend;
+	int input[2], sock[2];
+	int i, failed = 0;
+
+	/* the frontend prompts for every move, none of that is interesting */
+	if ((i = open("/dev/null", O_WRONLY)) < 0 || dup2(i, STDOUT_FILENO) < 0) {
+		perror("Failed to open /dev/null");
+		return 1;
+	}
+	close(i);
+	/* the frontend reads moves from stdin, which is fed from `input[1]` */
+	if (pipe(input) < 0 || dup2(input[0], STDIN_FILENO) < 0) {
+		perror("Failed to set up stdin");
+		return 1;
+	}
+	close(input[0]);
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sock) < 0) {
+		perror("Failed to create a socket pair");
+		return 1;
+	}
+	if ((frontend = new_text_frontend(NULL, NULL)) == NULL) {
+		fputs("Failed to create the frontend\n", stderr);
+		return 1;
+	}
+
+	for (i = 0; i < GAMES; ++i) {
+		int bad = play_game(frontend, input[1], sock, 2 * i + 1);
+		if (bad < 0) {
+			return 1;
+		}
+		failed += bad;
+	}
+
+	frontend->free(frontend);
+	if (failed) {
+		fprintf(stderr, "%d moves allocated memory\n", failed);
+		return 1;
+	}
+	fputs("No allocations after the start of the game\n", stderr);
+	return 0;
+}
+
+static int play_game(struct frontend *frontend, int input, int sock[2], int stride) {
+	struct game *us, *peer;
+	struct move_list list;
+	char line[MOVE_STRING_LEN + 1], move[MOVE_STRING_LEN], sent[MOVE_STRING_LEN];
+	int ply, bad = 0, ret = 0;
+
+	if ((us = new_game()) == NULL) {
+		fputs("Failed to create a game\n", stderr);
+		return -1;
+	}
+	if ((peer = new_game()) == NULL) {
+		fputs("Failed to create a game\n", stderr);
+		free_game(us);
+		return -1;
+	}
+
+	for (ply = 0; ply < MAX_PLIES; ++ply) {
+		unsigned long before = allocations;
+		int count, code;
+		size_t len;
+
+		if ((count = generate_legal_moves(us, &list)) == 0) {
+			break;
+		}
+		move_to_string(&list.moves[ply * stride % count], line);
+		len = strlen(line);
+		line[len++] = '\n';
+		if (write(input, line, len) != (ssize_t) len) {
+			perror("Failed to write the move");
+			goto error;
+		}
+
+		if (frontend->get_move(frontend->aux, get_player(us), move) < 0) {
+			fputs("The frontend didn't read a move\n", stderr);
+			goto error;
+		}
+		switch (code = parse_move(us, move)) {
+		case NONFATAL_ERROR:
+			fprintf(stderr, "A legal move was rejected: %s\n", move);
+			goto error;
+		}
+		len = strlen(move) + 1;
+		if (write(sock[0], move, len) != (ssize_t) len ||
+				read(sock[1], sent, len) != (ssize_t) len) {
+			perror("Failed to send the move");
+			goto error;
+		}
+		if (parse_move(peer, sent) != code || game_hash(peer) != game_hash(us)) {
+			fprintf(stderr, "The peer didn't play %s the same way\n", sent);
+			goto error;
+		}
+
+		/* the first move is allowed to set things up, like stdio's buffers */
+		if (ply > 0 && allocations != before) {
+			fprintf(stderr, "%s allocated %lu times\n", move,
+					allocations - before);
+			++bad;
+		}
+		if (code < 0) {
+			break;
+		}
+	}
+	ret = bad;
+	goto end;
+error:
+	ret = -1;
+end:
+	free_game(us);
+	free_game(peer);
+	return ret;
+}
+
+void *__wrap_malloc(size_t size) {
+	++allocations;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+	++allocations;
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	++allocations;
+	return __real_realloc(ptr, size);
+}
@@ -0,0 +1,94 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+/* Checks that `init_game` turns down positions that can't come up in a game,
+ * and that the ones it takes come back out of `game_to_fen` unchanged. */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <client/chess.h>
+
+static const char *const rejected[] = {
+	/* no black king */
+	"8/8/8/8/8/8/8/4K3 w - - 0 1",
+	/* two white kings */
+	"4k3/8/8/8/8/8/8/3KK3 w - - 0 1",
+	/* a pawn on the last row */
+	"P3k3/8/8/8/8/8/8/4K3 w - - 0 1",
+	/* black is in check with white to move */
+	"4k3/8/8/8/8/8/8/4R1K1 w - - 0 1",
+	/* castling without the rook */
+	"4k3/8/8/8/8/8/8/4K3 w K - 0 1",
+	/* en pessant without a pawn that just jumped */
+	"4k3/8/8/8/8/8/8/4K3 w - d6 0 1",
+	/* en pessant on the wrong row for the player to move */
+	"4k3/8/8/3pP3/8/8/8/4K3 w - d3 0 1",
+	/* en pessant onto an occupied square, taking on d6 would also take
+	 * the pawn on d5 */
+	"4k3/8/3n4/3pP3/8/8/8/4K3 w - d6 0 1",
+	/* en pessant past a piece on the square the pawn jumped from */
+	"4k3/3n4/8/3pP3/8/8/8/4K3 w - d6 0 1",
+	/* and the same two for black */
+	"4k3/8/8/8/3Pp3/3N4/8/4K3 b - d3 0 1",
+	"4k3/8/8/8/3Pp3/8/3N4/4K3 b - d3 0 1",
+	/* a clock that isn't a number */
+	"4k3/8/8/8/8/8/8/4K3 w - - x 1",
+};
+
+static const char *const accepted[] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 1",
+	"4k3/8/8/8/3Pp3/8/8/4K3 b - d3 0 1",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 12 34",
+};
+
+int main(void) {
+	struct game *game;
+	char fen[FEN_MAX_LEN];
+	int failed = 0;
+
+	if ((game = new_game()) == NULL) {
+		fputs("Failed to create a game\n", stderr);
+		return 1;
+	}
+	for (size_t i = 0; i < sizeof rejected / sizeof *rejected; ++i) {
+		if (init_game(game, rejected[i]) == 0) {
+			fprintf(stderr, "Accepted an impossible position: %s\n", rejected[i]);
+			++failed;
+		}
+	}
+	for (size_t i = 0; i < sizeof accepted / sizeof *accepted; ++i) {
+		if (init_game(game, accepted[i]) < 0) {
+			fprintf(stderr, "Rejected a real position: %s\n", accepted[i]);
+			++failed;
+		}
+		else if (strcmp(game_to_fen(game, fen), accepted[i]) != 0) {
+			fprintf(stderr, "%s came back as %s\n", accepted[i], fen);
+			++failed;
+		}
+	}
+	free_game(game);
+
+	if (failed) {
+		return 1;
+	}
+	puts("Every FEN was accepted or rejected the way it should be");
+	return 0;
+}
@@ -0,0 +1,99 @@
+/* chessh - chess over ssh
+ * Copyright (C) 2024  Nate Choe <nate@natechoe.dev>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+/* Checks every entry of the sliding piece tables against a plain walk along
+ * the rays. The tables are indexed with `pext` on cpus that have a fast one
+ * and with the magic multiplication everywhere else, `make test` runs this
+ * once normally and once with CHESSH_NO_PEXT set so that both get checked. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <client/bitboard.h>
+
+static const int rook_directions[4][2] = { {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+static const int bishop_directions[4][2] = { {-1, -1}, {-1, 1}, {1, -1}, {1, 1} };
+
+/* the squares a slider on `sq` moving in `directions` attacks */
+static uint64_t walk(int sq, const int directions[4][2], uint64_t occupied);
+
+/* checks every subset of the blockers of every square for one kind of slider,
+ * returns the number of wrong entries */
+static int check_slider(const char *name, const struct magic magics[64],
+		uint64_t (*attacks)(int sq, uint64_t occupied), const int directions[4][2]);
+
+int main(void) {
+	int wrong;
+
+	init_bitboards();
+	wrong = check_slider("rook", rook_magics, rook_attacks, rook_directions) +
+		check_slider("bishop", bishop_magics, bishop_attacks, bishop_directions);
+	if (wrong) {
+		fprintf(stderr, "%d wrong attack sets\n", wrong);
+		return 1;
+	}
+	printf("Slider tables are right when they're indexed with %s\n",
+			have_pext ? "pext" : "the multiplication");
+	return 0;
+}
+
+static uint64_t walk(int sq, const int directions[4][2], uint64_t occupied) {
+	uint64_t ret = 0;
+	for (int i = 0; i < 4; ++i) {
+		int r = ROW(sq) + directions[i][0];
+		int c = COL(sq) + directions[i][1];
+		while (0 <= r && r < 8 && 0 <= c && c < 8) {
+			ret |= BIT(SQUARE(r, c));
+			if (occupied & BIT(SQUARE(r, c))) {
+				break;
+			}
+			r += directions[i][0];
+			c += directions[i][1];
+		}
+	}
+	return ret;
+}
+
+static int check_slider(const char *name, const struct magic magics[64],
+		uint64_t (*attacks)(int sq, uint64_t occupied), const int directions[4][2]) {
+	uint64_t seed = UINT64_C(0x9e3779b97f4a7c15);
+	int wrong = 0;
+
+	for (int sq = 0; sq < 64; ++sq) {
+		uint64_t mask = magics[sq].mask;
+		uint64_t subset = 0;
+		do {
+			/* squares outside the mask don't matter, so fill some of
+			 * them in to make sure they're ignored */
+			uint64_t occupied;
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			occupied = subset | (seed & ~mask);
+			if (attacks(sq, occupied) != walk(sq, directions, occupied)) {
+				if (wrong++ == 0) {
+					fprintf(stderr, "The %s on square %d is wrong with "
+							"occupancy %016llx\n", name, sq,
+							(unsigned long long) occupied);
+				}
+			}
+			subset = (subset - mask) & mask;
+		} while (subset != 0);
+	}
+	return wrong;
+}